@@ -0,0 +1,111 @@
+// Measures pwrite() throughput on module06 (or module05 with shared_open=1) with
+// 1..N threads, each writing its own region of the buffer, to show writers to
+// disjoint ranges scaling with the striped range locks. Load the module with a
+// large buffer_size first.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, uint64_t)
+
+#define IO_SIZE 4096
+#define STRIPES 16          // RAM_STRIPES in module05.c and module06.c
+#define SECONDS 2
+
+struct writer {
+    pthread_t thread;
+    int fd;
+    uint64_t base;          // Start of this thread's region
+    uint64_t span;          // Bytes in the region
+    uint64_t bytes;         // Out: bytes written
+};
+
+static volatile int stop;
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *writer_fn(void *arg) {
+    struct writer *w = arg;
+    char buf[IO_SIZE];
+    uint64_t off = 0;
+
+    memset(buf, 'e', sizeof(buf));
+    while (!stop) {
+        if (pwrite(w->fd, buf, IO_SIZE, w->base + off) != IO_SIZE) {
+            perror("pwrite");
+            break;
+        }
+        w->bytes += IO_SIZE;
+        off += IO_SIZE;
+        if (off + IO_SIZE > w->span)
+            off = 0;
+    }
+    return NULL;
+}
+
+// Run n writers; with shared != 0 they all hammer the first stripe instead
+static double run(int fd, uint64_t size, int n, int shared) {
+    struct writer *w = calloc(n, sizeof(*w));
+    uint64_t total = 0;
+    double t;
+    int i;
+
+    stop = 0;
+    for (i = 0; i < n; i++) {
+        w[i].fd = fd;
+        w[i].span = shared ? size / STRIPES : size / n;
+        w[i].base = shared ? 0 : i * w[i].span;
+        pthread_create(&w[i].thread, NULL, writer_fn, &w[i]);
+    }
+    t = now_s();
+    sleep(SECONDS);
+    stop = 1;
+    for (i = 0; i < n; i++) {
+        pthread_join(w[i].thread, NULL);
+        total += w[i].bytes;
+    }
+    t = now_s() - t;
+    free(w);
+    return total / t / (1 << 20);
+}
+
+int main(int argc, char **argv) {
+    const char *dev = argc > 1 ? argv[1] : "/dev/ram_array6";
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    uint64_t size;
+    int fd, n;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror(dev);
+        return 1;
+    }
+    if (ioctl(fd, RAM_GET_SIZE64, &size) < 0) {
+        perror("RAM_GET_SIZE64");
+        return 1;
+    }
+    if (size < (uint64_t)STRIPES * IO_SIZE || size < (uint64_t)max_threads * IO_SIZE) {
+        fprintf(stderr, "Buffer too small: load the module with a larger buffer_size\n");
+        return 1;
+    }
+
+    printf("Buffer: %llu MiB, %d KiB writes\n", (unsigned long long)(size >> 20), IO_SIZE >> 10);
+    printf("threads  disjoint MB/s  same-region MB/s\n");
+    for (n = 1; n <= max_threads; n *= 2)
+        printf("%7d  %13.0f  %16.0f\n", n, run(fd, size, n, 0), run(fd, size, n, 1));
+
+    close(fd);
+    return 0;
+}
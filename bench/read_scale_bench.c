@@ -0,0 +1,116 @@
+// Measures small pread() throughput with 1..N reader threads, optionally with
+// one writer running alongside, so the rwlock (module06), RCU (module07) and
+// seqlock (module09) drivers can be compared on many cores.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, uint64_t)
+
+#define IO_SIZE 64
+#define SECONDS 2
+
+struct worker {
+    pthread_t thread;
+    int fd;
+    unsigned int seed;
+    uint64_t ops;           // Out
+};
+
+static volatile int stop;
+static uint64_t slots;      // Number of IO_SIZE slots in the buffer
+
+static void *reader_fn(void *arg) {
+    struct worker *w = arg;
+    char buf[IO_SIZE];
+
+    while (!stop) {
+        if (pread(w->fd, buf, IO_SIZE, (rand_r(&w->seed) % slots) * IO_SIZE) != IO_SIZE) {
+            perror("pread");
+            break;
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+static void *writer_fn(void *arg) {
+    struct worker *w = arg;
+    char buf[IO_SIZE];
+
+    memset(buf, 'o', sizeof(buf));
+    while (!stop) {
+        if (pwrite(w->fd, buf, IO_SIZE, (rand_r(&w->seed) % slots) * IO_SIZE) != IO_SIZE) {
+            perror("pwrite");
+            break;
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+static double run(const char *dev, int readers, int with_writer) {
+    struct worker *w = calloc(readers + 1, sizeof(*w));
+    uint64_t total = 0;
+    int i;
+
+    stop = 0;
+    for (i = 0; i < readers + with_writer; i++) {
+        // One open per thread, as separate processes would have
+        w[i].fd = open(dev, O_RDWR);
+        if (w[i].fd < 0) {
+            perror(dev);
+            exit(1);
+        }
+        w[i].seed = i + 1;
+        pthread_create(&w[i].thread, NULL, i < readers ? reader_fn : writer_fn, &w[i]);
+    }
+    sleep(SECONDS);
+    stop = 1;
+    for (i = 0; i < readers + with_writer; i++) {
+        pthread_join(w[i].thread, NULL);
+        close(w[i].fd);
+        if (i < readers)
+            total += w[i].ops;
+    }
+    free(w);
+    return total / (double)SECONDS / 1e6;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t size;
+    int d, fd, n;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <max_threads> <device>...\n", argv[0]);
+        return 1;
+    }
+
+    for (d = 2; d < argc; d++) {
+        fd = open(argv[d], O_RDWR);
+        if (fd < 0 || ioctl(fd, RAM_GET_SIZE64, &size) < 0) {
+            perror(argv[d]);
+            return 1;
+        }
+        close(fd);
+        slots = size / IO_SIZE;
+        if (!slots) {
+            fprintf(stderr, "%s: buffer smaller than %d bytes\n", argv[d], IO_SIZE);
+            return 1;
+        }
+
+        printf("%s\n", argv[d]);
+        printf("readers  Mreads/s  Mreads/s (+1 writer)\n");
+        for (n = 1; n <= max_threads; n *= 2)
+            printf("%7d  %8.2f  %8.2f\n", n, run(argv[d], n, 0), run(argv[d], n, 1));
+    }
+    return 0;
+}
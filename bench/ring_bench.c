@@ -0,0 +1,213 @@
+// Measures the round-trip latency of small reads and writes on module06 through
+// pread/pwrite and through the submission/completion rings, with the doorbell
+// ioctl and with the SQPOLL kthread.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_RING_SETUP _IOWR(RAM_IOC_MAGIC, 11, struct ram_ring_setup)
+#define RAM_RING_ENTER _IO(RAM_IOC_MAGIC, 12)
+
+#define RAM_OP_READ 0
+#define RAM_OP_WRITE 1
+
+#define RAM_RING_SQPOLL 0x1
+#define RAM_RING_NEED_WAKEUP 0x1
+#define RAM_RING_OFF (1ULL << 40)
+
+// Same layout as in module06.c
+struct ram_ring_hdr {
+    __u32 sq_head;
+    __u32 pad0[15];
+    __u32 sq_tail;
+    __u32 pad1[15];
+    __u32 cq_head;
+    __u32 pad2[15];
+    __u32 cq_tail;
+    __u32 pad3[15];
+    __u32 entries;
+    __u32 flags;
+};
+
+struct ram_sqe {
+    __u32 opcode;
+    __u32 reserved;
+    __u64 offset;
+    __u64 length;
+    __u64 data;
+    __u64 user_data;
+};
+
+struct ram_cqe {
+    __u64 user_data;
+    __s64 result;
+};
+
+struct ram_ring_setup {
+    __u32 entries;
+    __u32 flags;
+    __u32 data_size;
+    __u32 sq_idle_ms;
+    __u32 sq_off;
+    __u32 cq_off;
+    __u32 data_off;
+    __u32 ring_size;
+};
+
+#define ENTRIES 64
+#define IO_SIZE 64
+
+struct ring {
+    struct ram_ring_hdr *hdr;
+    struct ram_sqe *sqes;
+    struct ram_cqe *cqes;
+    char *data;
+    size_t size;
+    int sqpoll;
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int ring_open(const char *dev, int sqpoll, struct ring *r) {
+    struct ram_ring_setup setup = {
+        .entries = ENTRIES,
+        .flags = sqpoll ? RAM_RING_SQPOLL : 0,
+        .data_size = ENTRIES * IO_SIZE,
+        .sq_idle_ms = 1000,
+    };
+    char *mem;
+    int fd = open(dev, O_RDWR);
+
+    if (fd < 0)
+        return -1;
+    if (ioctl(fd, RAM_RING_SETUP, &setup) < 0) {
+        close(fd);
+        return -1;
+    }
+    mem = mmap(NULL, setup.ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, RAM_RING_OFF);
+    if (mem == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    r->hdr = (struct ram_ring_hdr *)mem;
+    r->sqes = (struct ram_sqe *)(mem + setup.sq_off);
+    r->cqes = (struct ram_cqe *)(mem + setup.cq_off);
+    r->data = mem + setup.data_off;
+    r->size = setup.ring_size;
+    r->sqpoll = sqpoll;
+    return fd;
+}
+
+// Unmap the ring before closing, or the ring and its SQPOLL kthread outlive the fd
+static void ring_close(int fd, struct ring *r) {
+    munmap(r->hdr, r->size);
+    close(fd);
+}
+
+// Submit one op and spin until its completion arrives
+static long ring_roundtrip(int fd, struct ring *r, unsigned int opcode, __u64 offset) {
+    struct ram_ring_hdr *h = r->hdr;
+    __u32 tail = h->sq_tail;
+    __u32 head = h->cq_head;
+    struct ram_sqe *sqe = &r->sqes[tail & (ENTRIES - 1)];
+    long result;
+
+    sqe->opcode = opcode;
+    sqe->offset = offset;
+    sqe->length = IO_SIZE;
+    sqe->data = (tail & (ENTRIES - 1)) * IO_SIZE;
+    sqe->user_data = tail;
+    __atomic_store_n(&h->sq_tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if (!r->sqpoll) {
+        if (ioctl(fd, RAM_RING_ENTER) < 0)
+            return -errno;
+    } else if (__atomic_load_n(&h->flags, __ATOMIC_SEQ_CST) & RAM_RING_NEED_WAKEUP) {
+        ioctl(fd, RAM_RING_ENTER);
+    }
+
+    while (__atomic_load_n(&h->cq_tail, __ATOMIC_ACQUIRE) == head)
+        ;
+    result = r->cqes[head & (ENTRIES - 1)].result;
+    __atomic_store_n(&h->cq_head, head + 1, __ATOMIC_RELEASE);
+    return result;
+}
+
+static void report(const char *name, double ns, int iters) {
+    printf("%-14s %8.0f ns/op\n", name, ns / iters);
+}
+
+int main(int argc, char **argv) {
+    const char *dev = argc > 1 ? argv[1] : "/dev/ram_array6";
+    int iters = argc > 2 ? atoi(argv[2]) : 100000;
+    char buf[IO_SIZE];
+    struct ring r;
+    double t;
+    int fd, i;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror(dev);
+        return 1;
+    }
+    memset(buf, 'a', sizeof(buf));
+
+    t = now_ns();
+    for (i = 0; i < iters; i++) {
+        if (pwrite(fd, buf, IO_SIZE, (i % 64) * IO_SIZE) != IO_SIZE ||
+            pread(fd, buf, IO_SIZE, (i % 64) * IO_SIZE) != IO_SIZE) {
+            perror("pwrite/pread");
+            return 1;
+        }
+    }
+    report("syscalls", (now_ns() - t) / 2, iters);
+    close(fd);
+
+    fd = ring_open(dev, 0, &r);
+    if (fd < 0) {
+        perror("ring setup");
+        return 1;
+    }
+    t = now_ns();
+    for (i = 0; i < iters; i++) {
+        if (ring_roundtrip(fd, &r, RAM_OP_WRITE, (i % 64) * IO_SIZE) != IO_SIZE ||
+            ring_roundtrip(fd, &r, RAM_OP_READ, (i % 64) * IO_SIZE) != IO_SIZE) {
+            fprintf(stderr, "ring op failed\n");
+            return 1;
+        }
+    }
+    report("ring+doorbell", (now_ns() - t) / 2, iters);
+    ring_close(fd, &r);
+
+    // Needs CAP_SYS_NICE for the polling kthread
+    fd = ring_open(dev, 1, &r);
+    if (fd < 0) {
+        perror("sqpoll ring setup");
+        return 0;
+    }
+    t = now_ns();
+    for (i = 0; i < iters; i++) {
+        if (ring_roundtrip(fd, &r, RAM_OP_WRITE, (i % 64) * IO_SIZE) != IO_SIZE ||
+            ring_roundtrip(fd, &r, RAM_OP_READ, (i % 64) * IO_SIZE) != IO_SIZE) {
+            fprintf(stderr, "ring op failed\n");
+            return 1;
+        }
+    }
+    report("ring+sqpoll", (now_ns() - t) / 2, iters);
+    ring_close(fd, &r);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Compares blocking ioctl() calls with the same commands submitted through
+// io_uring (IORING_OP_URING_CMD), which module06 and module07 accept through
+// their .uring_cmd handler. Needs liburing and a 6.0+ kernel.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <liburing.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
+#define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+
+#define DEPTH 64
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The 16-byte command area of the SQE holds struct ram_uring_cmd { __u64 arg; __u64 reserved; }
+static void prep_ram_cmd(struct io_uring_sqe *sqe, int fd, unsigned int cmd, void *arg) {
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = fd;
+    sqe->cmd_op = cmd;
+    sqe->addr3 = (uintptr_t)arg;
+}
+
+static int run_uring(struct io_uring *ring, int fd, unsigned int cmd, int iters, int *out) {
+    struct io_uring_cqe *cqe;
+    unsigned int head, seen;
+    int submitted = 0, done = 0;
+
+    while (done < iters) {
+        // Keep up to DEPTH commands in flight, each with its own result slot
+        while (submitted < iters && submitted - done < DEPTH) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+            if (!sqe)
+                break;
+            prep_ram_cmd(sqe, fd, cmd, &out[submitted % DEPTH]);
+            submitted++;
+        }
+        if (io_uring_submit_and_wait(ring, 1) < 0)
+            return -1;
+
+        seen = 0;
+        io_uring_for_each_cqe(ring, head, cqe) {
+            if (cqe->res < 0) {
+                fprintf(stderr, "uring_cmd: %s\n", strerror(-cqe->res));
+                return -1;
+            }
+            seen++;
+        }
+        io_uring_cq_advance(ring, seen);
+        done += seen;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dev = argc > 1 ? argv[1] : "/dev/ram_array6";
+    int iters = argc > 2 ? atoi(argv[2]) : 1000000;
+    const struct {
+        const char *name;
+        unsigned int cmd;
+    } cmds[] = {
+        { "RAM_GET_SIZE", RAM_GET_SIZE },
+        { "RAM_COUNT_VOWELS", RAM_COUNT_VOWELS },
+    };
+    struct io_uring ring;
+    int out[DEPTH];
+    double t;
+    int fd, i, c, ret;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror(dev);
+        return 1;
+    }
+    ret = io_uring_queue_init(DEPTH, &ring, 0);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_queue_init: %s\n", strerror(-ret));
+        return 1;
+    }
+
+    printf("%d commands each, queue depth %d\n", iters, DEPTH);
+    for (c = 0; c < (int)(sizeof(cmds) / sizeof(cmds[0])); c++) {
+        t = now_ns();
+        for (i = 0; i < iters; i++) {
+            if (ioctl(fd, cmds[c].cmd, &out[0]) < 0) {
+                perror("ioctl");
+                return 1;
+            }
+        }
+        printf("%-18s ioctl     %6.0f ns/op\n", cmds[c].name, (now_ns() - t) / iters);
+
+        t = now_ns();
+        if (run_uring(&ring, fd, cmds[c].cmd, iters, out))
+            return 1;
+        printf("%-18s io_uring  %6.0f ns/op\n", cmds[c].name, (now_ns() - t) / iters);
+    }
+
+    io_uring_queue_exit(&ring);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Compares the byte-at-a-time RAM_COUNT_VOWELS loop with the SWAR kernel used
+// by the drivers, in user space and, optionally, through the ioctl itself.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+
+typedef uint64_t u64;
+
+// Same code as ram_count_vowels() in the modules
+#define RAM_ONES (~0ULL / 0xff)
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t count_swar(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    while (len && ((uintptr_t)buf & (sizeof(u64) - 1))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += __builtin_popcountll(hits);
+    }
+
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
+
+// The loop the modules used before
+static size_t count_bytewise(const char *buf, size_t len) {
+    size_t count = 0, i;
+
+    for (i = 0; i < len; i++) {
+        char c = buf[i];
+        if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
+            c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U')
+            count++;
+    }
+    return count;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *name, size_t (*fn)(const char *, size_t),
+                  const char *buf, size_t len, int iters) {
+    volatile size_t sink = 0;
+    double t;
+    int i;
+
+    t = now_sec();
+    for (i = 0; i < iters; i++)
+        sink += fn(buf, len);
+    t = now_sec() - t;
+    printf("%-10s %8.1f MB/s  (%zu vowels)\n", name, (double)len * iters / t / 1e6, sink / iters);
+}
+
+int main(int argc, char *argv[]) {
+    size_t len = (argc > 1 ? strtoul(argv[1], NULL, 0) : 64) << 20;
+    int iters = 10;
+    char *buf = malloc(len);
+    size_t i;
+
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+
+    // Printable text, so the vowel density is realistic
+    srand(1);
+    for (i = 0; i < len; i++)
+        buf[i] = ' ' + rand() % 95;
+
+    if (count_bytewise(buf, len) != count_swar(buf, len)) {
+        fprintf(stderr, "Mismatch between byte loop and SWAR kernel\n");
+        return 1;
+    }
+
+    printf("Buffer: %zu MiB, %d iterations\n", len >> 20, iters);
+    bench("bytewise", count_bytewise, buf, len, iters);
+    bench("swar", count_swar, buf, len, iters);
+
+    // Optionally time the real ioctl: ./vowel_bench <MiB> /dev/ram_array6
+    if (argc > 2) {
+        int fd = open(argv[2], O_RDWR);
+        double t;
+        int count = 0;
+
+        if (fd < 0) {
+            perror("Failed to open device");
+            return 1;
+        }
+        t = now_sec();
+        for (i = 0; i < (size_t)iters; i++) {
+            if (ioctl(fd, RAM_COUNT_VOWELS, &count) < 0) {
+                perror("RAM_COUNT_VOWELS failed");
+                close(fd);
+                return 1;
+            }
+        }
+        t = now_sec() - t;
+        printf("%-10s %8.3f ms per call  (%d vowels)\n", "ioctl", t / iters * 1e3, count);
+        close(fd);
+    }
+
+    free(buf);
+    return 0;
+}
@@ -1,51 +1,123 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+
+#define CREATE_TRACE_POINTS
+#include "ram_array_trace.h"
 
 #define DEVICE_NAME "ram_array"
-#define ARRAY_SIZE 1024
+#define DEFAULT_BUFFER_SIZE 1024
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
 
 static int major;
 static char *ram_array;
 static int cursor = 0;
 static struct cdev ram_cdev;
 
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= ARRAY_SIZE) {
-        printk(KERN_INFO "ram_array: Read position out of bounds\n");
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied;
+
+    if (pos >= buffer_size) {
+        pr_debug("ram_array: Read position out of bounds\n");
         return 0;
     }
-    if (*pos + count > ARRAY_SIZE)
-        count = ARRAY_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
     
-    if (copy_to_user(buf, ram_array + *pos, count)) {
+    // One call covers every segment of a readv()/io_uring vector
+    copied = copy_to_iter(ram_array + pos, count, to);
+    if (!copied && count) {
         printk(KERN_ERR "ram_array: Failed to copy data to user\n");
+        ram_stat_inc(efaults);
         return -EFAULT;
     }
     
-    printk(KERN_INFO "ram_array: Read %zu bytes from position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_read(copied, pos);
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= ARRAY_SIZE) {
-        printk(KERN_INFO "ram_array: Write position out of bounds\n");
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied;
+
+    if (pos >= buffer_size) {
+        pr_debug("ram_array: Write position out of bounds\n");
         return 0;
     }
-    if (*pos + count > ARRAY_SIZE)
-        count = ARRAY_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
     
-    if (copy_from_user(ram_array + *pos, buf, count)) {
+    // One call covers every segment of a writev()/io_uring vector
+    copied = copy_from_iter(ram_array + pos, count, from);
+    if (!copied && count) {
         printk(KERN_ERR "ram_array: Failed to copy data from user\n");
+        ram_stat_inc(efaults);
         return -EFAULT;
     }
     
-    printk(KERN_INFO "ram_array: Wrote %zu bytes at position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_write(copied, pos);
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
 static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
@@ -53,44 +125,84 @@ static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
     switch (whence) {
         case SEEK_SET: new_pos = offset; break;
         case SEEK_CUR: new_pos = file->f_pos + offset; break;
-        case SEEK_END: new_pos = ARRAY_SIZE + offset; break;
+        case SEEK_END: new_pos = buffer_size + offset; break;
         default: return -EINVAL;
     }
-    if (new_pos < 0 || new_pos > ARRAY_SIZE)
+    if (new_pos < 0 || new_pos > buffer_size)
         return -EINVAL;
     
-    printk(KERN_INFO "ram_array: Seek to position %lld\n", new_pos);
+    trace_ram_seek(new_pos);
+    pr_debug("ram_array: Seek to position %lld\n", new_pos);
     file->f_pos = new_pos;
     return new_pos;
 }
 
+// Fault handler: map the vmalloc page backing the faulting offset
+static vm_fault_t ram_vm_fault(struct vm_fault *vmf) {
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (offset >= buffer_size)
+        return VM_FAULT_SIGBUS;
+
+    page = vmalloc_to_page(ram_array + offset);
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static const struct vm_operations_struct ram_vm_ops = {
+    .fault = ram_vm_fault,
+};
+
+static int ram_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long pages = PAGE_ALIGN(buffer_size) >> PAGE_SHIFT;
+
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+        return -EINVAL;
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &ram_vm_ops;
+    return 0;
+}
+
 static struct file_operations ram_fops = {
     .owner = THIS_MODULE,
-    .read = ram_read,
-    .write = ram_write,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
     .llseek = ram_seek,
+    .splice_read = copy_splice_read,        // sendfile()/splice() out of the device
+    .splice_write = iter_file_splice_write, // splice() into the device
+    .mmap = ram_mmap,
 };
 
 static int __init ram_init(void) {
+    if (!buffer_size)
+        return -EINVAL;
+
     major = register_chrdev(0, DEVICE_NAME, &ram_fops);
     if (major < 0) {
         printk(KERN_ALERT "Failed to register char device\n");
         return major;
     }
     
-    ram_array = kmalloc(ARRAY_SIZE, GFP_KERNEL);
+    // vmalloc only needs virtually contiguous pages, so the buffer can grow far beyond kmalloc limits
+    ram_array = vzalloc(buffer_size);
     if (!ram_array) {
         unregister_chrdev(major, DEVICE_NAME);
         return -ENOMEM;
     }
-    memset(ram_array, 0, ARRAY_SIZE);
     
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+
     printk(KERN_INFO "ram_array driver registered with major %d\n", major);
     return 0;
 }
 
 static void __exit ram_exit(void) {
-    kfree(ram_array);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    vfree(ram_array);
     unregister_chrdev(major, DEVICE_NAME);
     printk(KERN_INFO "ram_array driver unregistered\n");
 }
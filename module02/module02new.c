@@ -1,57 +1,188 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 // IOCTL Command Definitions
 #include <linux/ioctl.h>
+#include <linux/atomic.h>
+
+#define CREATE_TRACE_POINTS
+#include "ram_array_trace.h"
+
 #define RAM_IOC_MAGIC 'R'
 #define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)  // Read buffer size
 #define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)          // Clear buffer
 #define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int) // Count vowels
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64) // Read 64-bit buffer size
 
 #define DEVICE_NAME "ram_array2"
-#define BUFFER_SIZE 1024  // Renamed to avoid conflicts
+#define DEFAULT_BUFFER_SIZE 1024
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
 
 static int major;
 static char *ram_array;
+// Running vowel count, updated by every write so RAM_COUNT_VOWELS needn't scan
+static atomic_long_t ram_vowels = ATOMIC_LONG_INIT(0);
+static atomic_t ram_mmap_writers = ATOMIC_INIT(0);  // Shared writable mappings, which bypass ram_vowels
 static struct cdev ram_cdev __attribute__((unused)); // Marked unused to suppress warnings
 static int cursor __attribute__((unused)) = 0;       // Marked unused
 
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE) {
-        printk(KERN_INFO "ram_array: Read position out of bounds\n");
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array2/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+/*
+ * Count vowels eight bytes at a time (SWAR). OR-ing 0x20 into every byte
+ * folds 'A'..'Z' onto 'a'..'z' and maps nothing else onto a lowercase vowel,
+ * so each vowel needs one XOR plus an exact zero-byte test per word instead
+ * of ten compares per byte.
+ */
+#define RAM_ONES (~0ULL / 0xff)  // 0x0101010101010101
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+// 0x80 in every byte of x that is zero, without false positives from borrows
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t ram_count_vowels(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    // Head bytes up to the first aligned word
+    while (len && !IS_ALIGNED((unsigned long)buf, sizeof(u64))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += hweight64(hits);
+    }
+
+    // Tail bytes
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
+
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied;
+
+    if (pos >= buffer_size) {
+        pr_debug("ram_array: Read position out of bounds\n");
         return 0;
     }
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
     
-    if (copy_to_user(buf, ram_array + *pos, count)) {
+    // One call covers every segment of a readv()/io_uring vector
+    copied = copy_to_iter(ram_array + pos, count, to);
+    if (!copied && count) {
         printk(KERN_ERR "ram_array: Failed to copy data to user\n");
+        ram_stat_inc(efaults);
         return -EFAULT;
     }
     
-    printk(KERN_INFO "ram_array: Read %zu bytes from position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_read(copied, pos);
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE) {
-        printk(KERN_INFO "ram_array: Write position out of bounds\n");
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied;
+    long old;
+
+    if (pos >= buffer_size) {
+        pr_debug("ram_array: Write position out of bounds\n");
         return 0;
     }
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
     
-    if (copy_from_user(ram_array + *pos, buf, count)) {
+    old = ram_count_vowels(ram_array + pos, count);
+    // One call covers every segment of a writev()/io_uring vector
+    copied = copy_from_iter(ram_array + pos, count, from);
+    // Bytes past 'copied' are unchanged, so they cancel out of the difference
+    atomic_long_add((long)ram_count_vowels(ram_array + pos, count) - old, &ram_vowels);
+    if (!copied && count) {
         printk(KERN_ERR "ram_array: Failed to copy data from user\n");
+        ram_stat_inc(efaults);
         return -EFAULT;
     }
     
-    printk(KERN_INFO "ram_array: Wrote %zu bytes at position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_write(copied, pos);
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
 static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
@@ -59,44 +190,102 @@ static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
     switch (whence) {
         case SEEK_SET: new_pos = offset; break;
         case SEEK_CUR: new_pos = file->f_pos + offset; break;
-        case SEEK_END: new_pos = BUFFER_SIZE + offset; break;
+        case SEEK_END: new_pos = buffer_size + offset; break;
         default: return -EINVAL;
     }
-    if (new_pos < 0 || new_pos > BUFFER_SIZE)
+    if (new_pos < 0 || new_pos > buffer_size)
         return -EINVAL;
     
-    printk(KERN_INFO "ram_array: Seek to position %lld\n", new_pos);
+    trace_ram_seek(new_pos);
+    pr_debug("ram_array: Seek to position %lld\n", new_pos);
     file->f_pos = new_pos;
     return new_pos;
 }
 
-static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    int count = 0, i;
-    int buffer_size = BUFFER_SIZE; // Temporary variable for copy_to_user
+// Fault handler: map the vmalloc page backing the faulting offset
+static vm_fault_t ram_vm_fault(struct vm_fault *vmf) {
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (offset >= buffer_size)
+        return VM_FAULT_SIGBUS;
+
+    page = vmalloc_to_page(ram_array + offset);
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static bool ram_vma_writable(struct vm_area_struct *vma) {
+    // VM_MAYWRITE rather than VM_WRITE, since mprotect() can add write access later
+    return (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) == (VM_SHARED | VM_MAYWRITE);
+}
+
+static void ram_vm_open(struct vm_area_struct *vma) {
+    if (ram_vma_writable(vma))
+        atomic_inc(&ram_mmap_writers);
+}
+
+static void ram_vm_close(struct vm_area_struct *vma) {
+    // Resync the running count once the last writable mapping is gone
+    if (ram_vma_writable(vma) && atomic_dec_and_test(&ram_mmap_writers))
+        atomic_long_set(&ram_vowels, ram_count_vowels(ram_array, buffer_size));
+}
+
+static const struct vm_operations_struct ram_vm_ops = {
+    .open = ram_vm_open,
+    .close = ram_vm_close,
+    .fault = ram_vm_fault,
+};
+
+static int ram_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long pages = PAGE_ALIGN(buffer_size) >> PAGE_SHIFT;
+
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+        return -EINVAL;
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &ram_vm_ops;
+    ram_vm_open(vma);  // ->open() is only called for copies and splits of the VMA
+    return 0;
+}
+
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int count = 0;
+    int size = min_t(unsigned long, buffer_size, INT_MAX);
+    u64 size64 = buffer_size;
     
     switch (cmd) {
         case RAM_GET_SIZE:
-            //if (copy_to_user((int __user *)arg, &buffer_size, sizeof(int)))
-               // return -EFAULT;
-            printk(KERN_INFO "ram_array Size: %d\n", buffer_size);
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
+                return -EFAULT;
+            trace_ram_ioctl(cmd, size);
+            pr_debug("ram_array Size: %d\n", size);
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
+                return -EFAULT;
+            trace_ram_ioctl(cmd, size64);
             break;
 
         case RAM_CLEAR:
-            memset(ram_array, 0, BUFFER_SIZE);
-            printk(KERN_INFO "ram_array: Buffer cleared\n");
+            memset(ram_array, 0, buffer_size);
+            atomic_long_set(&ram_vowels, 0);
+            trace_ram_ioctl(cmd, 0);
+            pr_debug("ram_array: Buffer cleared\n");
             break;
 
         case RAM_COUNT_VOWELS:
-            for (i = 0; i < BUFFER_SIZE; i++) {
-                char c = ram_array[i];
-                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
-                    c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U') {
-                    count++;
-                }
-            }
+            // Stores through a shared writable mapping are invisible to ram_vowels, so scan while one exists
+            if (atomic_read(&ram_mmap_writers))
+                count = min_t(size_t, ram_count_vowels(ram_array, buffer_size), INT_MAX);
+            else
+                count = min_t(long, atomic_long_read(&ram_vowels), INT_MAX);
             if (copy_to_user((int __user *)arg, &count, sizeof(int)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array: Counted %d vowels\n", count);
+            trace_ram_ioctl(cmd, count);
+            pr_debug("ram_array: Counted %d vowels\n", count);
             break;
 
         default:
@@ -105,34 +294,52 @@ static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    long ret = ram_do_ioctl(file, cmd, arg);
+
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
 static struct file_operations ram_fops = {
     .owner = THIS_MODULE,
-    .read = ram_read,
-    .write = ram_write,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
     .llseek = ram_seek,
+    .splice_read = copy_splice_read,        // sendfile()/splice() out of the device
+    .splice_write = iter_file_splice_write, // splice() into the device
     .unlocked_ioctl = ram_ioctl, // Register IOCTL handler
+    .mmap = ram_mmap,
 };
 
 static int __init ram_init(void) {
+    if (!buffer_size)
+        return -EINVAL;
+
     major = register_chrdev(0, DEVICE_NAME, &ram_fops);
     if (major < 0) {
         printk(KERN_ALERT "Failed to register char device\n");
         return major;
     }
     
-    ram_array = kmalloc(BUFFER_SIZE, GFP_KERNEL);
+    ram_array = vzalloc(buffer_size);
     if (!ram_array) {
         unregister_chrdev(major, DEVICE_NAME);
         return -ENOMEM;
     }
-    memset(ram_array, 0, BUFFER_SIZE);
     
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+
     printk(KERN_INFO "ram_array driver registered with major %d\n", major);
     return 0;
 }
 
 static void __exit ram_exit(void) {
-    kfree(ram_array);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    vfree(ram_array);
     unregister_chrdev(major, DEVICE_NAME);
     printk(KERN_INFO "ram_array driver unregistered\n");
 }
@@ -69,17 +69,17 @@ int main() {
     //}
     //
     //
-    int fd;
-
-    // Retry loop for open()
-    while ((fd = open(DEVICE_PATH, O_RDWR)) == -1) {
-        if (errno == EBUSY) {
-            printf("Device busy, retrying...\n");
-            usleep(100000); // Sleep for 100ms before retry
-        } else {
-            perror("Failed to open device");
-            return 1;
-        }
+    // O_NONBLOCK only to find out whether to say we're waiting; the blocking open sleeps in the driver
+    int fd = open(DEVICE_PATH, O_RDWR | O_NONBLOCK);
+    if (fd == -1 && errno == EAGAIN) {
+        printf("Device busy, waiting for it...\n");
+        fd = open(DEVICE_PATH, O_RDWR);
+    } else if (fd != -1) {
+        fcntl(fd, F_SETFL, 0);
+    }
+    if (fd == -1) {
+        perror("Failed to open device");
+        return 1;
     }
 
     printf("Device opened successfully with fd = %d\n", fd);
@@ -1,93 +1,516 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 #include <linux/ioctl.h>
+#include <linux/atomic.h>
 #include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#define CREATE_TRACE_POINTS
+#include "ram_array_trace.h"
 
 #define RAM_IOC_MAGIC 'R'
 #define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
 #define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)
 #define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64)
 
 #define DEVICE_NAME "ram_array4"
-#define BUFFER_SIZE 1024
+#define DEFAULT_BUFFER_SIZE 1024
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
 
 static int major;
 static char *ram_array;
+// Running vowel count, updated by every write so RAM_COUNT_VOWELS needn't scan
+static atomic_long_t ram_vowels = ATOMIC_LONG_INIT(0);
+static atomic_t ram_mmap_writers = ATOMIC_INIT(0);  // Shared writable mappings, which bypass ram_vowels
+static atomic_t ram_vowels_stale = ATOMIC_INIT(0);  // A writable mapping went away; rescan on the next count
+#define RAM_NO_RESYNC SIZE_MAX
+static size_t ram_resync_pos = RAM_NO_RESYNC;  // How far a running rescan has got; under ram_data_lock()
+static long ram_resync_delta;  // Vowel changes behind ram_resync_pos during a rescan; under ram_data_lock()
 static spinlock_t ram_spinlock;
 static int device_open = 0;
+static DECLARE_WAIT_QUEUE_HEAD(ram_open_wq);  // Exclusive opens sleeping until the device is released
+static u64 ram_open_acquired;  // When the current holder claimed the device (latency_hist only)
+
+// Off: one open at a time, -EBUSY for the rest. On: any number of opens, ram_spinlock held per call
+static bool shared_open;
+module_param(shared_open, bool, 0444);
+MODULE_PARM_DESC(shared_open, "Allow concurrent opens and lock per read/write/ioctl instead of per open (default off)");
+
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 opens;
+    u64 busy;
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array4/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.opens += s->opens;
+        sum.busy += s->busy;
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "opens:         %llu\n", sum.opens);
+    seq_printf(m, "busy:          %llu\n", sum.busy);
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+/*
+ * Optional latency histograms, one per operation and phase. "lock_wait" is
+ * the time spent acquiring the device lock, "run" is the time spent holding
+ * it (or, for unlocked paths, copying). Bucket b counts samples in
+ * [2^(b-1), 2^b) ns; the last bucket also takes everything slower.
+ */
+static bool latency_hist;
+module_param(latency_hist, bool, 0644);
+MODULE_PARM_DESC(latency_hist, "Record per-operation latency histograms in debugfs (default off)");
+
+enum ram_lat_op { RAM_LAT_OPEN, RAM_LAT_READ, RAM_LAT_WRITE, RAM_LAT_IOCTL, RAM_LAT_NR_OPS };
+enum ram_lat_phase { RAM_LAT_WAIT, RAM_LAT_RUN, RAM_LAT_NR_PHASES };
+#define RAM_LAT_BUCKETS 32
+
+static const char * const ram_lat_op_names[RAM_LAT_NR_OPS] = { "open", "read", "write", "ioctl" };
+static const char * const ram_lat_phase_names[RAM_LAT_NR_PHASES] = { "lock_wait", "run" };
+
+struct ram_latency {
+    u64 hist[RAM_LAT_NR_OPS][RAM_LAT_NR_PHASES][RAM_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct ram_latency, ram_latency);
+
+// Returns a start timestamp, or 0 when histograms are off
+static inline u64 ram_lat_start(void) {
+    return READ_ONCE(latency_hist) ? ktime_get_ns() : 0;
+}
+
+// Records the phase that began at 'start' and returns the end time, so the next phase can chain from it
+static inline u64 ram_lat_record(int op, int phase, u64 start) {
+    u64 now;
+
+    if (!start)
+        return 0;
+    now = ktime_get_ns();
+    this_cpu_inc(ram_latency.hist[op][phase][min(fls64(now - start), RAM_LAT_BUCKETS - 1)]);
+    return now;
+}
+
+// debugfs: <debugfs>/ram_array4/latency, summed over all CPUs on read; any write resets it
+static int ram_latency_show(struct seq_file *m, void *v) {
+    u64 sum[RAM_LAT_BUCKETS];
+    int op, phase, b, cpu;
+
+    for (op = 0; op < RAM_LAT_NR_OPS; op++) {
+        for (phase = 0; phase < RAM_LAT_NR_PHASES; phase++) {
+            u64 total = 0;
+
+            memset(sum, 0, sizeof(sum));
+            for_each_possible_cpu(cpu) {
+                struct ram_latency *l = per_cpu_ptr(&ram_latency, cpu);
+
+                for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                    sum[b] += l->hist[op][phase][b];
+            }
+            for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                total += sum[b];
+            if (!total)
+                continue;
+
+            seq_printf(m, "%s %s: %llu samples\n", ram_lat_op_names[op], ram_lat_phase_names[phase], total);
+            for (b = 0; b < RAM_LAT_BUCKETS; b++) {
+                if (!sum[b])
+                    continue;
+                if (b == RAM_LAT_BUCKETS - 1)
+                    seq_printf(m, "  >= %10llu ns: %llu\n", 1ULL << (b - 1), sum[b]);
+                else
+                    seq_printf(m, "  <  %10llu ns: %llu\n", 1ULL << b, sum[b]);
+            }
+        }
+    }
+    return 0;
+}
+
+static int ram_latency_open(struct inode *inode, struct file *file) {
+    return single_open(file, ram_latency_show, inode->i_private);
+}
+
+static ssize_t ram_latency_reset(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&ram_latency, cpu), 0, sizeof(struct ram_latency));
+    return count;
+}
+
+static const struct file_operations ram_latency_fops = {
+    .owner = THIS_MODULE,
+    .open = ram_latency_open,
+    .read = seq_read,
+    .write = ram_latency_reset,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/*
+ * Count vowels eight bytes at a time (SWAR). OR-ing 0x20 into every byte
+ * folds 'A'..'Z' onto 'a'..'z' and maps nothing else onto a lowercase vowel,
+ * so each vowel needs one XOR plus an exact zero-byte test per word instead
+ * of ten compares per byte.
+ */
+#define RAM_ONES (~0ULL / 0xff)  // 0x0101010101010101
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+// 0x80 in every byte of x that is zero, without false positives from borrows
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t ram_count_vowels(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    // Head bytes up to the first aligned word
+    while (len && !IS_ALIGNED((unsigned long)buf, sizeof(u64))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += hweight64(hits);
+    }
+
+    // Tail bytes
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
 
 // Function prototypes
 static int ram_open(struct inode *inode, struct file *file);
 static int ram_release(struct inode *inode, struct file *file);
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos);
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos);
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from);
 static loff_t ram_seek(struct file *file, loff_t offset, int whence);
 static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int ram_mmap(struct file *file, struct vm_area_struct *vma);
 
 static struct file_operations ram_fops = {
     .owner = THIS_MODULE,
     .open = ram_open,
     .release = ram_release,
-    .read = ram_read,
-    .write = ram_write,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
     .llseek = ram_seek,
+    .splice_read = copy_splice_read,        // sendfile()/splice() out of the device
+    .splice_write = iter_file_splice_write, // splice() into the device
     .unlocked_ioctl = ram_ioctl,
+    .mmap = ram_mmap,
 };
 
-// Open function with spinlock
-static int ram_open(struct inode *inode, struct file *file) {
+// With shared_open, the buffer is only touched under ram_spinlock. It is never taken
+// from interrupt context, so the data path needn't disable interrupts
+static void ram_data_lock(void) {
+    if (shared_open)
+        spin_lock(&ram_spinlock);
+}
+
+static void ram_data_unlock(void) {
+    if (shared_open)
+        spin_unlock(&ram_spinlock);
+}
+
+// Under ram_data_lock(): how many bytes at the start of [pos, pos + len) a change must be counted for.
+// While a rescan runs, bytes past its cursor are left for the rescan to count as it finds them
+static size_t ram_counted_len(size_t pos, size_t len) {
+    if (ram_resync_pos == RAM_NO_RESYNC || pos + len <= ram_resync_pos)
+        return len;
+    return pos < ram_resync_pos ? ram_resync_pos - pos : 0;
+}
+
+// Under ram_data_lock(): account a change over bytes measured with ram_counted_len()
+static void ram_vowels_add(long delta) {
+    if (ram_resync_pos == RAM_NO_RESYNC)
+        atomic_long_add(delta, &ram_vowels);
+    else
+        ram_resync_delta += delta;
+}
+
+// Whole-buffer operations take the spinlock one page at a time, so shared_open
+// users never spin behind a multi-gigabyte memset or scan
+static void ram_clear_all(void) {
+    size_t off, n;
+
+    for (off = 0; off < buffer_size; off += n) {
+        n = min_t(size_t, PAGE_SIZE, buffer_size - off);
+        ram_data_lock();
+        // Subtract rather than zero the count: writers to other pages keep adding their deltas
+        ram_vowels_add(-(long)ram_count_vowels(ram_array + off, ram_counted_len(off, n)));
+        memset(ram_array + off, 0, n);
+        ram_data_unlock();
+        cond_resched();
+    }
+}
+
+static size_t ram_scan_vowels(void) {
+    size_t off, n, count = 0;
+
+    for (off = 0; off < buffer_size; off += n) {
+        n = min_t(size_t, PAGE_SIZE, buffer_size - off);
+        ram_data_lock();
+        count += ram_count_vowels(ram_array + off, n);
+        ram_data_unlock();
+        cond_resched();
+    }
+    return count;
+}
+
+/*
+ * Rebuild ram_vowels after the last writable mapping went away, a page at a
+ * time like ram_scan_vowels(), while shared_open writers keep going. Writes
+ * behind the cursor are collected in ram_resync_delta; writes ahead of it are
+ * seen by the scan itself. Returns false if another rescan is still running,
+ * in which case ram_vowels cannot be trusted yet.
+ */
+static bool ram_resync_vowels(void) {
+    size_t off, n;
+    long count = 0;
+
+    ram_data_lock();
+    if (ram_resync_pos != RAM_NO_RESYNC) {
+        ram_data_unlock();
+        return false;
+    }
+    if (!atomic_xchg(&ram_vowels_stale, 0)) {
+        ram_data_unlock();
+        return true;
+    }
+    ram_resync_pos = 0;
+    ram_resync_delta = 0;
+    ram_data_unlock();
+
+    for (off = 0; off < buffer_size; off += n) {
+        n = min_t(size_t, PAGE_SIZE, buffer_size - off);
+        ram_data_lock();
+        count += ram_count_vowels(ram_array + off, n);
+        ram_resync_pos = off + n;
+        if (ram_resync_pos == buffer_size) {
+            atomic_long_set(&ram_vowels, count + ram_resync_delta);
+            ram_resync_pos = RAM_NO_RESYNC;
+        }
+        ram_data_unlock();
+        cond_resched();
+    }
+    return true;
+}
+
+// Claims the device for an exclusive open if nobody holds it
+static bool ram_try_claim(void) {
     unsigned long flags;
+    bool claimed;
+
     spin_lock_irqsave(&ram_spinlock, flags);
+    claimed = !device_open;
+    if (claimed)
+        device_open++;
+    spin_unlock_irqrestore(&ram_spinlock, flags);
+    return claimed;
+}
 
-    if (device_open) {
-        spin_unlock_irqrestore(&ram_spinlock, flags);
-        printk(KERN_INFO "ram_array: Device already open, returning -EBUSY\n");
-        return -EBUSY;
+// Open function with spinlock
+static int ram_open(struct inode *inode, struct file *file) {
+    u64 start;
+
+    if (shared_open) {
+        printk(KERN_INFO "ram_array: Device opened (shared)\n");
+        ram_stat_inc(opens);
+        return 0;
     }
 
-    device_open++;
-    spin_unlock_irqrestore(&ram_spinlock, flags);
+    start = ram_lat_start();
+    if (!ram_try_claim()) {
+        ram_stat_inc(busy);
+        if (file->f_flags & O_NONBLOCK) {
+            ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
+            printk(KERN_INFO "ram_array: Device already open, returning -EAGAIN\n");
+            return -EAGAIN;
+        }
+        /*
+         * Sleep until the holder releases the device. The wait is exclusive,
+         * so each release wakes a single opener rather than all of them; one
+         * that loses the race to a new open just goes back to sleep.
+         */
+        if (wait_event_interruptible_exclusive(ram_open_wq, ram_try_claim())) {
+            ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
+            return -ERESTARTSYS;
+        }
+    }
+    // The device is held until release, so that is the "run" phase of open
+    ram_open_acquired = ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
     printk(KERN_INFO "ram_array: Device opened\n");
+    ram_stat_inc(opens);
     return 0;
 }
 
 // Release function with spinlock
 static int ram_release(struct inode *inode, struct file *file) {
     unsigned long flags;
-    spin_lock_irqsave(&ram_spinlock, flags);
-
-    device_open--;
 
-    spin_unlock_irqrestore(&ram_spinlock, flags);
+    if (!shared_open) {
+        ram_lat_record(RAM_LAT_OPEN, RAM_LAT_RUN, ram_open_acquired);
+        spin_lock_irqsave(&ram_spinlock, flags);
+        device_open--;
+        spin_unlock_irqrestore(&ram_spinlock, flags);
+        // Hand the device to the next sleeping opener, if there is one
+        if (wq_has_sleeper(&ram_open_wq))
+            wake_up_interruptible(&ram_open_wq);
+    }
     printk(KERN_INFO "ram_array: Device released\n");
     return 0;
 }
 
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE) return 0;
-    if (*pos + count > BUFFER_SIZE) count = BUFFER_SIZE - *pos;
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied = 0, n, w;
+    u64 start;
+
+    if (pos >= buffer_size) return 0;
+    if (count > buffer_size - pos) count = buffer_size - pos;
 
-    if (copy_to_user(buf, ram_array + *pos, count))
+    /*
+     * Without shared_open the spinlock only guards open/release and the copy
+     * is unlocked. With it, the copy runs a page at a time under the
+     * spinlock, like ram_clear_all(), where a user page fault must not sleep:
+     * copy with page faults disabled and, if that comes up short, fault the
+     * rest of the page in outside the lock and retry.
+     */
+    while (copied < count) {
+        w = min_t(size_t, count - copied, PAGE_SIZE);
+        start = ram_lat_start();
+        ram_data_lock();
+        if (shared_open)
+            start = ram_lat_record(RAM_LAT_READ, RAM_LAT_WAIT, start);
+        pagefault_disable();
+        n = copy_to_iter(ram_array + pos + copied, w, to);
+        pagefault_enable();
+        ram_data_unlock();
+        ram_lat_record(RAM_LAT_READ, RAM_LAT_RUN, start);
+
+        copied += n;
+        if (n < w && fault_in_iov_iter_writeable(to, w - n) == w - n)
+            break;
+        cond_resched();
+    }
+    if (!copied && count) {
+        ram_stat_inc(efaults);
         return -EFAULT;
+    }
 
-    printk(KERN_INFO "ram_array: Read %zu bytes from position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_read(copied, pos);
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE) return 0;
-    if (*pos + count > BUFFER_SIZE) count = BUFFER_SIZE - *pos;
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied = 0, n, w, counted;
+    long old;
+    u64 start;
+
+    if (pos >= buffer_size) return 0;
+    if (count > buffer_size - pos) count = buffer_size - pos;
+
+    // Same scheme as ram_read_iter()
+    while (copied < count) {
+        w = min_t(size_t, count - copied, PAGE_SIZE);
+        start = ram_lat_start();
+        ram_data_lock();
+        if (shared_open)
+            start = ram_lat_record(RAM_LAT_WRITE, RAM_LAT_WAIT, start);
+        counted = ram_counted_len(pos + copied, w);
+        old = ram_count_vowels(ram_array + pos + copied, counted);
+        pagefault_disable();
+        n = copy_from_iter(ram_array + pos + copied, w, from);
+        pagefault_enable();
+        // Bytes past 'n' are unchanged, so they cancel out of the difference
+        ram_vowels_add((long)ram_count_vowels(ram_array + pos + copied, counted) - old);
+        ram_data_unlock();
+        ram_lat_record(RAM_LAT_WRITE, RAM_LAT_RUN, start);
 
-    if (copy_from_user(ram_array + *pos, buf, count))
+        copied += n;
+        if (n < w && fault_in_iov_iter_readable(from, w - n) == w - n)
+            break;
+        cond_resched();
+    }
+    if (!copied && count) {
+        ram_stat_inc(efaults);
         return -EFAULT;
+    }
 
-    printk(KERN_INFO "ram_array: Wrote %zu bytes at position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_write(copied, pos);
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
 static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
@@ -95,41 +518,102 @@ static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
     switch (whence) {
         case SEEK_SET: new_pos = offset; break;
         case SEEK_CUR: new_pos = file->f_pos + offset; break;
-        case SEEK_END: new_pos = BUFFER_SIZE + offset; break;
+        case SEEK_END: new_pos = buffer_size + offset; break;
         default: return -EINVAL;
     }
 
-    if (new_pos < 0 || new_pos > BUFFER_SIZE) return -EINVAL;
+    if (new_pos < 0 || new_pos > buffer_size) return -EINVAL;
+    trace_ram_seek(new_pos);
     file->f_pos = new_pos;
     return new_pos;
 }
 
-static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    int count = 0, i;
-    int buffer_size = BUFFER_SIZE;
+// Fault handler: map the vmalloc page backing the faulting offset
+static vm_fault_t ram_vm_fault(struct vm_fault *vmf) {
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (offset >= buffer_size)
+        return VM_FAULT_SIGBUS;
+
+    page = vmalloc_to_page(ram_array + offset);
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static bool ram_vma_writable(struct vm_area_struct *vma) {
+    // VM_MAYWRITE rather than VM_WRITE, since mprotect() can add write access later
+    return (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) == (VM_SHARED | VM_MAYWRITE);
+}
+
+static void ram_vm_open(struct vm_area_struct *vma) {
+    if (ram_vma_writable(vma))
+        atomic_inc(&ram_mmap_writers);
+}
+
+static void ram_vm_close(struct vm_area_struct *vma) {
+    // Runs under mmap_lock, so it neither takes the spinlock nor scans: RAM_COUNT_VOWELS resyncs the count
+    if (ram_vma_writable(vma) && atomic_dec_and_test(&ram_mmap_writers))
+        atomic_set(&ram_vowels_stale, 1);
+}
+
+static const struct vm_operations_struct ram_vm_ops = {
+    .open = ram_vm_open,
+    .close = ram_vm_close,
+    .fault = ram_vm_fault,
+};
+
+static int ram_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long pages = PAGE_ALIGN(buffer_size) >> PAGE_SHIFT;
+
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+        return -EINVAL;
+
+    // The mapping holds a reference to the file, so an exclusive open lasts until munmap.
+    // Stores through the mapping never take ram_spinlock, even with shared_open
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &ram_vm_ops;
+    ram_vm_open(vma);  // ->open() is only called for copies and splits of the VMA
+    return 0;
+}
+
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int count = 0;
+    int size = min_t(unsigned long, buffer_size, INT_MAX);
+    u64 size64 = buffer_size;
 
     switch (cmd) {
         case RAM_GET_SIZE:
-            if (copy_to_user((int __user *)arg, &buffer_size, sizeof(int)))
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array Size: %d\n", buffer_size);
+            trace_ram_ioctl(cmd, size);
+            pr_debug("ram_array Size: %d\n", size);
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
+                return -EFAULT;
+            trace_ram_ioctl(cmd, size64);
             break;
 
         case RAM_CLEAR:
-            memset(ram_array, 0, BUFFER_SIZE);
-            printk(KERN_INFO "ram_array: Buffer cleared\n");
+            ram_clear_all();
+            trace_ram_ioctl(cmd, 0);
+            pr_debug("ram_array: Buffer cleared\n");
             break;
 
         case RAM_COUNT_VOWELS:
-            for (i = 0; i < BUFFER_SIZE; i++) {
-                char c = ram_array[i];
-                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
-                    c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U')
-                    count++;
-            }
+            // Stores through a shared writable mapping are invisible to ram_vowels, so scan while one exists
+            // Also scan while another caller is still rebuilding the count
+            if (atomic_read(&ram_mmap_writers) || !ram_resync_vowels())
+                count = min_t(size_t, ram_scan_vowels(), INT_MAX);
+            else
+                count = min_t(long, atomic_long_read(&ram_vowels), INT_MAX);
             if (copy_to_user((int __user *)arg, &count, sizeof(int)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array: Counted %d vowels\n", count);
+            trace_ram_ioctl(cmd, count);
+            pr_debug("ram_array: Counted %d vowels\n", count);
             break;
 
         default:
@@ -138,28 +622,47 @@ static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 start = ram_lat_start();
+    long ret = ram_do_ioctl(file, cmd, arg);
+
+    ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
 static int __init ram_init(void) {
+    if (!buffer_size)
+        return -EINVAL;
+
+    // Everything an open file can reach is set up before the device appears
+    spin_lock_init(&ram_spinlock);
+    ram_array = vzalloc(buffer_size);
+    if (!ram_array)
+        return -ENOMEM;
+
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+    debugfs_create_file("latency", 0644, ram_debugfs_dir, NULL, &ram_latency_fops);
+
     major = register_chrdev(0, DEVICE_NAME, &ram_fops);
     if (major < 0) {
         printk(KERN_ALERT "Failed to register char device\n");
+        debugfs_remove_recursive(ram_debugfs_dir);
+        vfree(ram_array);
         return major;
     }
 
-    ram_array = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-    if (!ram_array) {
-        unregister_chrdev(major, DEVICE_NAME);
-        return -ENOMEM;
-    }
-    memset(ram_array, 0, BUFFER_SIZE);
-
-    spin_lock_init(&ram_spinlock);
     printk(KERN_INFO "ram_array driver registered with major %d\n", major);
     return 0;
 }
 
 static void __exit ram_exit(void) {
-    kfree(ram_array);
     unregister_chrdev(major, DEVICE_NAME);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    vfree(ram_array);
     printk(KERN_INFO "ram_array driver unregistered\n");
 }
 
@@ -0,0 +1,81 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ram_array4
+
+#if !defined(_RAM_ARRAY_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _RAM_ARRAY_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Tracepoints for the ram_array4 hot paths. They replace the per-call
+ * printk()s and cost only a patched-out branch while disabled. Enable with
+ *   echo 1 > /sys/kernel/tracing/events/ram_array4/enable
+ * or record with perf record -e 'ram_array4:*'.
+ */
+
+DECLARE_EVENT_CLASS(ram_array_io,
+    TP_PROTO(size_t count, loff_t pos),
+    TP_ARGS(count, pos),
+
+    TP_STRUCT__entry(
+        __field(size_t, count)
+        __field(loff_t, pos)
+    ),
+
+    TP_fast_assign(
+        __entry->count = count;
+        __entry->pos = pos;
+    ),
+
+    TP_printk("count=%zu pos=%lld", __entry->count, __entry->pos)
+);
+
+DEFINE_EVENT(ram_array_io, ram_read,
+    TP_PROTO(size_t count, loff_t pos),
+    TP_ARGS(count, pos)
+);
+
+DEFINE_EVENT(ram_array_io, ram_write,
+    TP_PROTO(size_t count, loff_t pos),
+    TP_ARGS(count, pos)
+);
+
+TRACE_EVENT(ram_seek,
+    TP_PROTO(loff_t pos),
+    TP_ARGS(pos),
+
+    TP_STRUCT__entry(
+        __field(loff_t, pos)
+    ),
+
+    TP_fast_assign(
+        __entry->pos = pos;
+    ),
+
+    TP_printk("pos=%lld", __entry->pos)
+);
+
+TRACE_EVENT(ram_ioctl,
+    TP_PROTO(unsigned int cmd, u64 value),
+    TP_ARGS(cmd, value),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, cmd)
+        __field(u64, value)
+    ),
+
+    TP_fast_assign(
+        __entry->cmd = cmd;
+        __entry->value = value;
+    ),
+
+    TP_printk("cmd=0x%x value=%llu", __entry->cmd, __entry->value)
+);
+
+#endif /* _RAM_ARRAY_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ram_array_trace
+#include <trace/define_trace.h>
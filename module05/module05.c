@@ -1,82 +1,514 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 #include <linux/ioctl.h>
+#include <linux/atomic.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/nodemask.h>
+#include <linux/log2.h>
+
+#define CREATE_TRACE_POINTS
+#include "ram_array_trace.h"
 
 #define RAM_IOC_MAGIC 'R'
 #define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
 #define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)
 #define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64)
 
 #define DEVICE_NAME "ram_array5"
-#define BUFFER_SIZE 1024
+#define DEFAULT_BUFFER_SIZE 1024
+#define RAM_MAX_DEVS 256
+
+/*
+ * Byte-range locking for shared_open, as in module06: each instance's buffer
+ * is split into at most RAM_STRIPES stripes of 1 << ram_stripe_shift bytes
+ * (at least a page), each with its own mutex. A call locks the stripes its
+ * range touches in ascending order, so writers to disjoint stripes run in
+ * parallel. Every stripe index has its own lockdep class because a wide range
+ * holds several of them at once.
+ */
+#define RAM_STRIPES 16
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
+
+static unsigned int nr_devs = 1;
+module_param(nr_devs, uint, 0444);
+MODULE_PARM_DESC(nr_devs, "Number of device instances (minors), spread over the online NUMA nodes (default 1)");
 
 static int major;
-static char *ram_array;
-static struct mutex ram_mutex;
+
+// A buffer and its bookkeeping: a device instance's own, or one open's with private_open
+struct ram_buf {
+    char *data;
+    // Running vowel count, updated by every write so RAM_COUNT_VOWELS needn't scan
+    atomic_long_t vowels;
+    atomic_t mmap_writers;  // Shared writable mappings, which bypass 'vowels'
+    atomic_t vowels_stale;  // A writable mapping went away; rescan on the next count
+    struct mutex *stripes;  // RAM_STRIPES range locks taken per call (shared_open), or NULL
+};
+
+/*
+ * One minor. Everything an open touches lives here and is allocated on the
+ * instance's NUMA node, so workers that use the instance local to them never
+ * share a buffer, lock or cacheline with other nodes.
+ */
+struct ram_dev {
+    struct cdev cdev;
+    struct ram_buf buf;
+    struct mutex mutex;
+    struct mutex stripes[RAM_STRIPES];
+    bool claimed;  // An exclusive open holds the device; guarded by 'mutex'
+    wait_queue_head_t open_wq;  // Exclusive opens sleeping until the device is released
+    u64 open_acquired;  // When the current holder claimed the device (latency_hist only)
+    int node;
+};
+
+static struct ram_dev **ram_devs;
+static struct lock_class_key ram_stripe_keys[RAM_STRIPES];
+static unsigned int ram_stripe_shift;
+static struct kmem_cache *ram_buf_cache;  // struct ram_buf for private_open
+
+// Off: one open at a time, claimed under the instance mutex. On: any number of opens, range locks held per call
+static bool shared_open;
+module_param(shared_open, bool, 0444);
+MODULE_PARM_DESC(shared_open, "Allow concurrent opens and lock the byte range of each read/write/ioctl instead of the device per open (default off)");
+
+// Each open gets a zeroed buffer of its own in file->private_data, which nothing else can reach
+static bool private_open;
+module_param(private_open, bool, 0444);
+MODULE_PARM_DESC(private_open, "Give every open its own buffer, with no locking at all (default off; overrides shared_open)");
+
+// Each private buffer is a vzalloc() of buffer_size, so how many can be live at once is capped
+static unsigned int max_private = 64;
+module_param(max_private, uint, 0644);
+MODULE_PARM_DESC(max_private, "Most private_open buffers live at once, over all minors; further opens get -EBUSY (default 64)");
+static atomic_t ram_private_bufs = ATOMIC_INIT(0);
+
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 opens;
+    u64 busy;
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array5/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.opens += s->opens;
+        sum.busy += s->busy;
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "opens:         %llu\n", sum.opens);
+    seq_printf(m, "busy:          %llu\n", sum.busy);
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+/*
+ * Optional latency histograms, one per operation and phase. "lock_wait" is
+ * the time spent acquiring the device lock, "run" is the time spent holding
+ * it (or, for unlocked paths, copying). Bucket b counts samples in
+ * [2^(b-1), 2^b) ns; the last bucket also takes everything slower.
+ */
+static bool latency_hist;
+module_param(latency_hist, bool, 0644);
+MODULE_PARM_DESC(latency_hist, "Record per-operation latency histograms in debugfs (default off)");
+
+enum ram_lat_op { RAM_LAT_OPEN, RAM_LAT_READ, RAM_LAT_WRITE, RAM_LAT_IOCTL, RAM_LAT_NR_OPS };
+enum ram_lat_phase { RAM_LAT_WAIT, RAM_LAT_RUN, RAM_LAT_NR_PHASES };
+#define RAM_LAT_BUCKETS 32
+
+static const char * const ram_lat_op_names[RAM_LAT_NR_OPS] = { "open", "read", "write", "ioctl" };
+static const char * const ram_lat_phase_names[RAM_LAT_NR_PHASES] = { "lock_wait", "run" };
+
+struct ram_latency {
+    u64 hist[RAM_LAT_NR_OPS][RAM_LAT_NR_PHASES][RAM_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct ram_latency, ram_latency);
+
+// Returns a start timestamp, or 0 when histograms are off
+static inline u64 ram_lat_start(void) {
+    return READ_ONCE(latency_hist) ? ktime_get_ns() : 0;
+}
+
+// Records the phase that began at 'start' and returns the end time, so the next phase can chain from it
+static inline u64 ram_lat_record(int op, int phase, u64 start) {
+    u64 now;
+
+    if (!start)
+        return 0;
+    now = ktime_get_ns();
+    this_cpu_inc(ram_latency.hist[op][phase][min(fls64(now - start), RAM_LAT_BUCKETS - 1)]);
+    return now;
+}
+
+// debugfs: <debugfs>/ram_array5/latency, summed over all CPUs on read; any write resets it
+static int ram_latency_show(struct seq_file *m, void *v) {
+    u64 sum[RAM_LAT_BUCKETS];
+    int op, phase, b, cpu;
+
+    for (op = 0; op < RAM_LAT_NR_OPS; op++) {
+        for (phase = 0; phase < RAM_LAT_NR_PHASES; phase++) {
+            u64 total = 0;
+
+            memset(sum, 0, sizeof(sum));
+            for_each_possible_cpu(cpu) {
+                struct ram_latency *l = per_cpu_ptr(&ram_latency, cpu);
+
+                for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                    sum[b] += l->hist[op][phase][b];
+            }
+            for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                total += sum[b];
+            if (!total)
+                continue;
+
+            seq_printf(m, "%s %s: %llu samples\n", ram_lat_op_names[op], ram_lat_phase_names[phase], total);
+            for (b = 0; b < RAM_LAT_BUCKETS; b++) {
+                if (!sum[b])
+                    continue;
+                if (b == RAM_LAT_BUCKETS - 1)
+                    seq_printf(m, "  >= %10llu ns: %llu\n", 1ULL << (b - 1), sum[b]);
+                else
+                    seq_printf(m, "  <  %10llu ns: %llu\n", 1ULL << b, sum[b]);
+            }
+        }
+    }
+    return 0;
+}
+
+static int ram_latency_open(struct inode *inode, struct file *file) {
+    return single_open(file, ram_latency_show, inode->i_private);
+}
+
+static ssize_t ram_latency_reset(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&ram_latency, cpu), 0, sizeof(struct ram_latency));
+    return count;
+}
+
+static const struct file_operations ram_latency_fops = {
+    .owner = THIS_MODULE,
+    .open = ram_latency_open,
+    .read = seq_read,
+    .write = ram_latency_reset,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/*
+ * Count vowels eight bytes at a time (SWAR). OR-ing 0x20 into every byte
+ * folds 'A'..'Z' onto 'a'..'z' and maps nothing else onto a lowercase vowel,
+ * so each vowel needs one XOR plus an exact zero-byte test per word instead
+ * of ten compares per byte.
+ */
+#define RAM_ONES (~0ULL / 0xff)  // 0x0101010101010101
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+// 0x80 in every byte of x that is zero, without false positives from borrows
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t ram_count_vowels(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    // Head bytes up to the first aligned word
+    while (len && !IS_ALIGNED((unsigned long)buf, sizeof(u64))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += hweight64(hits);
+    }
+
+    // Tail bytes
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
 
 // Function prototypes
 static int ram_open(struct inode *inode, struct file *file);
 static int ram_release(struct inode *inode, struct file *file);
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos);
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos);
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from);
 static loff_t ram_seek(struct file *file, loff_t offset, int whence);
 static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int ram_mmap(struct file *file, struct vm_area_struct *vma);
 
 static struct file_operations ram_fops = {
     .owner = THIS_MODULE,
     .open = ram_open,
     .release = ram_release,
-    .read = ram_read,
-    .write = ram_write,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
     .llseek = ram_seek,
+    .splice_read = copy_splice_read,        // sendfile()/splice() out of the device
+    .splice_write = iter_file_splice_write, // splice() into the device
     .unlocked_ioctl = ram_ioctl,
+    .mmap = ram_mmap,
 };
 
+static void ram_stripe_range(u64 pos, u64 len, unsigned int *first, unsigned int *last) {
+    *first = min_t(u64, pos >> ram_stripe_shift, RAM_STRIPES - 1);
+    *last = len ? min_t(u64, (pos + len - 1) >> ram_stripe_shift, RAM_STRIPES - 1) : *first;
+}
+
+// In shared_open mode each call locks the stripes of [pos, pos + len) itself; 'start' moves on to the end of
+// the wait. A private buffer is only reachable through its own file, so it needs no lock
+static int ram_op_lock(struct ram_buf *rb, u64 pos, u64 len, int op, u64 *start) {
+    unsigned int first, i, last;
+
+    if (!rb->stripes)
+        return 0;
+    ram_stripe_range(pos, len, &first, &last);
+    for (i = first; i <= last; i++) {
+        if (mutex_lock_interruptible(&rb->stripes[i])) {
+            while (i-- > first)
+                mutex_unlock(&rb->stripes[i]);
+            return -ERESTARTSYS;
+        }
+    }
+    *start = ram_lat_record(op, RAM_LAT_WAIT, *start);
+    return 0;
+}
+
+static void ram_op_unlock(struct ram_buf *rb, u64 pos, u64 len) {
+    unsigned int i, last;
+
+    if (!rb->stripes)
+        return;
+    for (ram_stripe_range(pos, len, &i, &last); i <= last; i++)
+        mutex_unlock(&rb->stripes[i]);
+}
+
+static struct ram_buf *ram_buf_alloc(int node) {
+    struct ram_buf *rb = kmem_cache_alloc_node(ram_buf_cache, GFP_KERNEL, node);
+
+    if (!rb)
+        return NULL;
+    // vmalloc'd like the instance buffer, so ram_vm_fault() can map it the same way
+    rb->data = vzalloc_node(buffer_size, node);
+    if (!rb->data) {
+        kmem_cache_free(ram_buf_cache, rb);
+        return NULL;
+    }
+    atomic_long_set(&rb->vowels, 0);
+    atomic_set(&rb->mmap_writers, 0);
+    atomic_set(&rb->vowels_stale, 0);
+    rb->stripes = NULL;
+    return rb;
+}
+
+static void ram_buf_free(struct ram_buf *rb) {
+    vfree(rb->data);
+    kmem_cache_free(ram_buf_cache, rb);
+}
+
 static int ram_open(struct inode *inode, struct file *file) {
-    if (!mutex_trylock(&ram_mutex)) {
-        printk(KERN_INFO "ram_array: Could not acquire mutex in open\n");
-        return -EBUSY;
+    struct ram_dev *dev = container_of(inode->i_cdev, struct ram_dev, cdev);
+    u64 start;
+
+    if (private_open) {
+        if (atomic_inc_return(&ram_private_bufs) > READ_ONCE(max_private)) {
+            atomic_dec(&ram_private_bufs);
+            ram_stat_inc(busy);
+            return -EBUSY;
+        }
+        // On the instance's node, like everything else the open touches
+        file->private_data = ram_buf_alloc(dev->node);
+        if (!file->private_data) {
+            atomic_dec(&ram_private_bufs);
+            return -ENOMEM;
+        }
+        printk(KERN_INFO "ram_array: Device opened (private)\n");
+        ram_stat_inc(opens);
+        return 0;
+    }
+
+    file->private_data = &dev->buf;
+    if (shared_open) {
+        printk(KERN_INFO "ram_array: Device opened (shared)\n");
+        ram_stat_inc(opens);
+        return 0;
+    }
+
+    start = ram_lat_start();
+    if (mutex_lock_interruptible(&dev->mutex))
+        return -ERESTARTSYS;
+
+    if (dev->claimed)
+        ram_stat_inc(busy);
+    // Sleep until the holder releases the device, as module08 does for an empty FIFO
+    while (dev->claimed) {
+        mutex_unlock(&dev->mutex);
+        if (file->f_flags & O_NONBLOCK) {
+            ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
+            printk(KERN_INFO "ram_array: Device already open, returning -EAGAIN\n");
+            return -EAGAIN;
+        }
+        // Exclusive wait: each release wakes a single opener rather than all of them
+        if (wait_event_interruptible_exclusive(dev->open_wq, !READ_ONCE(dev->claimed))) {
+            ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
+            return -ERESTARTSYS;
+        }
+        // Not interruptible: this waiter consumed the wakeup, so it must look at 'claimed' again
+        mutex_lock(&dev->mutex);
     }
+    dev->claimed = true;
+    mutex_unlock(&dev->mutex);
+
+    // The device is held until release, so that is the "run" phase of open
+    dev->open_acquired = ram_lat_record(RAM_LAT_OPEN, RAM_LAT_WAIT, start);
     printk(KERN_INFO "ram_array: Device opened\n");
+    ram_stat_inc(opens);
     return 0;
 }
 
 static int ram_release(struct inode *inode, struct file *file) {
-    mutex_unlock(&ram_mutex);
+    struct ram_dev *dev = container_of(inode->i_cdev, struct ram_dev, cdev);
+
+    if (private_open) {
+        // Last reference, so any mapping of the buffer is gone too
+        ram_buf_free(file->private_data);
+        atomic_dec(&ram_private_bufs);
+    } else if (!shared_open) {
+        ram_lat_record(RAM_LAT_OPEN, RAM_LAT_RUN, dev->open_acquired);
+        mutex_lock(&dev->mutex);
+        dev->claimed = false;
+        mutex_unlock(&dev->mutex);
+        // Hand the device to the next sleeping opener, if there is one
+        if (wq_has_sleeper(&dev->open_wq))
+            wake_up_interruptible(&dev->open_wq);
+    }
     printk(KERN_INFO "ram_array: Device released\n");
     return 0;
 }
 
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE)
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    struct ram_buf *rb = iocb->ki_filp->private_data;
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied;
+    u64 start;
+
+    if (pos >= buffer_size)
         return 0;
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
 
-    if (copy_to_user(buf, ram_array + *pos, count))
+    // Without shared_open there is no per-call lock: the device was claimed in open
+    start = ram_lat_start();
+    if (ram_op_lock(rb, pos, count, RAM_LAT_READ, &start))
+        return -ERESTARTSYS;
+    copied = copy_to_iter(rb->data + pos, count, to);
+    ram_op_unlock(rb, pos, count);
+    ram_lat_record(RAM_LAT_READ, RAM_LAT_RUN, start);
+    if (!copied && count) {
+        ram_stat_inc(efaults);
         return -EFAULT;
+    }
 
-    printk(KERN_INFO "ram_array: Read %zu bytes from position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_read(copied, pos);
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
-    if (*pos >= BUFFER_SIZE)
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct ram_buf *rb = iocb->ki_filp->private_data;
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied;
+    long old;
+    u64 start;
+
+    if (pos >= buffer_size)
         return 0;
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
 
-    if (copy_from_user(ram_array + *pos, buf, count))
+    start = ram_lat_start();
+    if (ram_op_lock(rb, pos, count, RAM_LAT_WRITE, &start))
+        return -ERESTARTSYS;
+    old = ram_count_vowels(rb->data + pos, count);
+    copied = copy_from_iter(rb->data + pos, count, from);
+    // Bytes past 'copied' are unchanged, so they cancel out of the difference
+    atomic_long_add((long)ram_count_vowels(rb->data + pos, count) - old, &rb->vowels);
+    ram_op_unlock(rb, pos, count);
+    ram_lat_record(RAM_LAT_WRITE, RAM_LAT_RUN, start);
+    if (!copied && count) {
+        ram_stat_inc(efaults);
         return -EFAULT;
+    }
 
-    printk(KERN_INFO "ram_array: Wrote %zu bytes at position %lld\n", count, *pos);
-    *pos += count;
-    return count;
+    trace_ram_write(copied, pos);
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
 static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
@@ -90,46 +522,132 @@ static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
             new_pos = file->f_pos + offset;
             break;
         case SEEK_END:
-            new_pos = BUFFER_SIZE + offset;
+            new_pos = buffer_size + offset;
             break;
         default:
             return -EINVAL;
     }
 
-    if (new_pos < 0 || new_pos > BUFFER_SIZE)
+    if (new_pos < 0 || new_pos > buffer_size)
         return -EINVAL;
 
+    trace_ram_seek(new_pos);
     file->f_pos = new_pos;
     return new_pos;
 }
 
-static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    int count = 0, i;
-    int buffer_size = BUFFER_SIZE;
+// Fault handler: map the vmalloc page backing the faulting offset
+static vm_fault_t ram_vm_fault(struct vm_fault *vmf) {
+    struct ram_buf *rb = vmf->vma->vm_file->private_data;
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (offset >= buffer_size)
+        return VM_FAULT_SIGBUS;
+
+    page = vmalloc_to_page(rb->data + offset);
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static bool ram_vma_writable(struct vm_area_struct *vma) {
+    // VM_MAYWRITE rather than VM_WRITE, since mprotect() can add write access later
+    return (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) == (VM_SHARED | VM_MAYWRITE);
+}
+
+static void ram_vm_open(struct vm_area_struct *vma) {
+    struct ram_buf *rb = vma->vm_file->private_data;
+
+    if (ram_vma_writable(vma))
+        atomic_inc(&rb->mmap_writers);
+}
+
+static void ram_vm_close(struct vm_area_struct *vma) {
+    struct ram_buf *rb = vma->vm_file->private_data;
+
+    // Runs under mmap_lock, which read()/write() take while holding the stripes when they fault on
+    // user pages, so it must not take them. RAM_COUNT_VOWELS resyncs the count instead
+    if (ram_vma_writable(vma) && atomic_dec_and_test(&rb->mmap_writers))
+        atomic_set(&rb->vowels_stale, 1);
+}
+
+static const struct vm_operations_struct ram_vm_ops = {
+    .open = ram_vm_open,
+    .close = ram_vm_close,
+    .fault = ram_vm_fault,
+};
+
+static int ram_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long pages = PAGE_ALIGN(buffer_size) >> PAGE_SHIFT;
+
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+        return -EINVAL;
+
+    // The mapping holds a reference to the file, so an exclusive open (or a private buffer)
+    // lasts until munmap. Stores through the mapping never take the mutex, even with shared_open
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &ram_vm_ops;
+    ram_vm_open(vma);  // ->open() is only called for copies and splits of the VMA
+    return 0;
+}
+
+// Only RAM_CLEAR and a vowel rescan cover the buffer, so only they take the stripes (all of them).
+// Everything else reads a constant or an atomic, and never waits behind writers
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg, u64 *start) {
+    struct ram_buf *rb = file->private_data;
+    int count = 0;
+    int size = min_t(unsigned long, buffer_size, INT_MAX);
+    u64 size64 = buffer_size;
 
     switch (cmd) {
         case RAM_GET_SIZE:
-            if (copy_to_user((int __user *)arg, &buffer_size, sizeof(int)))
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
+                return -EFAULT;
+            trace_ram_ioctl(cmd, size);
+            pr_debug("ram_array: Buffer size returned: %d\n", size);
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array: Buffer size returned: %d\n", buffer_size);
+            trace_ram_ioctl(cmd, size64);
             break;
 
         case RAM_CLEAR:
-            memset(ram_array, 0, BUFFER_SIZE);
-            printk(KERN_INFO "ram_array: Buffer cleared\n");
+            if (ram_op_lock(rb, 0, buffer_size, RAM_LAT_IOCTL, start))
+                return -ERESTARTSYS;
+            memset(rb->data, 0, buffer_size);
+            atomic_long_set(&rb->vowels, 0);
+            atomic_set(&rb->vowels_stale, 0);
+            ram_op_unlock(rb, 0, buffer_size);
+            trace_ram_ioctl(cmd, 0);
+            pr_debug("ram_array: Buffer cleared\n");
             break;
 
         case RAM_COUNT_VOWELS:
-            for (i = 0; i < BUFFER_SIZE; i++) {
-                char c = ram_array[i];
-                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
-                    c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U') {
-                    count++;
+            // Stores through a shared writable mapping are invisible to rb->vowels, so scan while one exists.
+            // Once the last one is gone, rebuild the count once; holding every stripe keeps a write() from
+            // landing between the scan and the store
+            if (atomic_read(&rb->mmap_writers) || atomic_read(&rb->vowels_stale)) {
+                if (ram_op_lock(rb, 0, buffer_size, RAM_LAT_IOCTL, start))
+                    return -ERESTARTSYS;
+                if (atomic_read(&rb->mmap_writers)) {
+                    count = min_t(size_t, ram_count_vowels(rb->data, buffer_size), INT_MAX);
+                } else {
+                    if (atomic_xchg(&rb->vowels_stale, 0))
+                        atomic_long_set(&rb->vowels, ram_count_vowels(rb->data, buffer_size));
+                    count = min_t(long, atomic_long_read(&rb->vowels), INT_MAX);
                 }
+                ram_op_unlock(rb, 0, buffer_size);
+            } else {
+                count = min_t(long, atomic_long_read(&rb->vowels), INT_MAX);
             }
+            // Copied out after the stripes are released: a fault here takes mmap_lock
             if (copy_to_user((int __user *)arg, &count, sizeof(int)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array: Counted %d vowels\n", count);
+            trace_ram_ioctl(cmd, count);
+            pr_debug("ram_array: Counted %d vowels\n", count);
             break;
 
         default:
@@ -139,29 +657,135 @@ static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 start = ram_lat_start();
+    long ret = ram_do_ioctl(file, cmd, arg, &start);
+
+    ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
+// The i-th online node, round robin, so nr_devs = number of nodes gives one instance per node
+static int ram_dev_node(unsigned int i) {
+    int node, n = i % num_online_nodes();
+
+    for_each_online_node(node)
+        if (!n--)
+            return node;
+    return NUMA_NO_NODE;
+}
+
+static struct ram_dev *ram_dev_create(unsigned int minor) {
+    int node = ram_dev_node(minor);
+    struct ram_dev *dev = kzalloc_node(sizeof(*dev), GFP_KERNEL, node);
+    int i;
+
+    if (!dev)
+        return NULL;
+    dev->buf.data = vzalloc_node(buffer_size, node);
+    if (!dev->buf.data) {
+        kfree(dev);
+        return NULL;
+    }
+    atomic_long_set(&dev->buf.vowels, 0);
+    atomic_set(&dev->buf.mmap_writers, 0);
+    atomic_set(&dev->buf.vowels_stale, 0);
+    dev->buf.stripes = shared_open ? dev->stripes : NULL;
+    mutex_init(&dev->mutex);
+    for (i = 0; i < RAM_STRIPES; i++) {
+        mutex_init(&dev->stripes[i]);
+        lockdep_set_class(&dev->stripes[i], &ram_stripe_keys[i]);
+    }
+    init_waitqueue_head(&dev->open_wq);
+    dev->node = node;
+
+    // Live as soon as cdev_add() returns, so it must come last
+    cdev_init(&dev->cdev, &ram_fops);
+    dev->cdev.owner = THIS_MODULE;
+    if (cdev_add(&dev->cdev, MKDEV(major, minor), 1)) {
+        vfree(dev->buf.data);
+        kfree(dev);
+        return NULL;
+    }
+    return dev;
+}
+
+// Tears down the first 'count' instances
+static void ram_devs_destroy(unsigned int count) {
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        cdev_del(&ram_devs[i]->cdev);
+        vfree(ram_devs[i]->buf.data);
+        kfree(ram_devs[i]);
+    }
+    kfree(ram_devs);
+}
+
+// debugfs: <debugfs>/ram_array5/instances, the node each minor was allocated on
+static int ram_instances_show(struct seq_file *m, void *v) {
+    unsigned int i;
+
+    for (i = 0; i < nr_devs; i++)
+        seq_printf(m, "minor %u: node %d\n", i, ram_devs[i]->node);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_instances);
+
 static int __init ram_init(void) {
-    major = register_chrdev(0, DEVICE_NAME, &ram_fops);
-    if (major < 0) {
+    dev_t devt;
+    unsigned int i;
+    int ret;
+
+    if (!buffer_size || !nr_devs || nr_devs > RAM_MAX_DEVS)
+        return -EINVAL;
+
+    ram_stripe_shift = max_t(unsigned int, PAGE_SHIFT,
+                             order_base_2(DIV_ROUND_UP(buffer_size, RAM_STRIPES)));
+
+    ret = alloc_chrdev_region(&devt, 0, nr_devs, DEVICE_NAME);
+    if (ret) {
         printk(KERN_ALERT "ram_array: Failed to register char device\n");
-        return major;
+        return ret;
     }
+    major = MAJOR(devt);
 
-    ram_array = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-    if (!ram_array) {
-        unregister_chrdev(major, DEVICE_NAME);
+    ram_buf_cache = KMEM_CACHE(ram_buf, 0);
+    ram_devs = kcalloc(nr_devs, sizeof(*ram_devs), GFP_KERNEL);
+    if (!ram_buf_cache || !ram_devs) {
+        kfree(ram_devs);
+        kmem_cache_destroy(ram_buf_cache);
+        unregister_chrdev_region(devt, nr_devs);
         return -ENOMEM;
     }
 
-    memset(ram_array, 0, BUFFER_SIZE);
-    mutex_init(&ram_mutex);
+    for (i = 0; i < nr_devs; i++) {
+        ram_devs[i] = ram_dev_create(i);
+        if (!ram_devs[i]) {
+            ram_devs_destroy(i);
+            kmem_cache_destroy(ram_buf_cache);
+            unregister_chrdev_region(devt, nr_devs);
+            return -ENOMEM;
+        }
+    }
+
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+    debugfs_create_file("latency", 0644, ram_debugfs_dir, NULL, &ram_latency_fops);
+    debugfs_create_file("instances", 0444, ram_debugfs_dir, NULL, &ram_instances_fops);
 
-    printk(KERN_INFO "ram_array: Driver registered with major number %d\n", major);
+    printk(KERN_INFO "ram_array: Driver registered with major number %d, %u minors\n", major, nr_devs);
     return 0;
 }
 
 static void __exit ram_exit(void) {
-    kfree(ram_array);
-    unregister_chrdev(major, DEVICE_NAME);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    ram_devs_destroy(nr_devs);
+    kmem_cache_destroy(ram_buf_cache);
+    unregister_chrdev_region(MKDEV(major, 0), nr_devs);
     printk(KERN_INFO "ram_array: Driver unregistered\n");
 }
 
@@ -1,87 +1,481 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/cdev.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 #include <linux/ioctl.h>
+#include <linux/workqueue.h>
+#include <linux/textsearch.h>
+#include <linux/crc32c.h>
+#include <linux/xxhash.h>
+#include <linux/io_uring/cmd.h>
+#include <linux/kthread.h>
+#include <linux/capability.h>
+#include <linux/log2.h>
 #include <linux/rwlock.h>
+#include <linux/lockdep.h>
+#include <linux/atomic.h>
+
+#define CREATE_TRACE_POINTS
+#include "ram_array_trace.h"
 
 #define RAM_IOC_MAGIC 'R'
 #define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
 #define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)
 #define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64)
+#define RAM_BYTE_HIST _IOWR(RAM_IOC_MAGIC, 6, struct ram_hist_req)
+#define RAM_SEARCH _IOWR(RAM_IOC_MAGIC, 7, struct ram_search_req)
+#define RAM_CHECKSUM _IOWR(RAM_IOC_MAGIC, 8, struct ram_csum_req)
+#define RAM_PAGE_CSUMS _IOWR(RAM_IOC_MAGIC, 9, struct ram_page_csums_req)
+#define RAM_BATCH _IOWR(RAM_IOC_MAGIC, 10, struct ram_batch)
+#define RAM_RING_SETUP _IOWR(RAM_IOC_MAGIC, 11, struct ram_ring_setup)
+#define RAM_RING_ENTER _IO(RAM_IOC_MAGIC, 12)
 
 #define DEVICE_NAME "ram_array6"
-#define BUFFER_SIZE 1024
+#define DEFAULT_BUFFER_SIZE 1024
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
+
+static bool page_csums;
+module_param(page_csums, bool, 0444);
+MODULE_PARM_DESC(page_csums, "Keep a CRC-32C per page of the buffer, updated on every write (default off)");
 
 static int major;
 static char *ram_array;
-static rwlock_t ram_rwlock;
+static atomic_long_t ram_vowels;  // Running vowel count, so RAM_COUNT_VOWELS needn't scan
+
+/*
+ * Byte-range locking: the buffer is split into at most RAM_STRIPES stripes of
+ * 1 << ram_stripe_shift bytes (at least a page), each with its own rwlock_t,
+ * so readers and writers of disjoint ranges do not contend. A range takes the
+ * lock of every stripe it touches, in ascending order; whole-buffer operations
+ * take all of them. Each stripe gets its own lockdep class because up to
+ * RAM_STRIPES of them nest.
+ */
+#define RAM_STRIPES 16
+
+// Bytes a read, write, batch or ring op handles under one acquisition before the locks are dropped for others
+#define RAM_BATCH_WINDOW (1 << 20)
+
+static rwlock_t ram_stripe_locks[RAM_STRIPES];
+static struct lock_class_key ram_stripe_keys[RAM_STRIPES];
+static unsigned int ram_stripe_shift;
+
+static void ram_stripe_range(u64 pos, u64 len, unsigned int *first, unsigned int *last) {
+    *first = min_t(u64, pos >> ram_stripe_shift, RAM_STRIPES - 1);
+    *last = len ? min_t(u64, (pos + len - 1) >> ram_stripe_shift, RAM_STRIPES - 1) : *first;
+}
+
+static void ram_range_read_lock(u64 pos, u64 len) {
+    unsigned int i, last;
+
+    for (ram_stripe_range(pos, len, &i, &last); i <= last; i++)
+        read_lock(&ram_stripe_locks[i]);
+}
+
+static void ram_range_read_unlock(u64 pos, u64 len) {
+    unsigned int i, last;
+
+    for (ram_stripe_range(pos, len, &i, &last); i <= last; i++)
+        read_unlock(&ram_stripe_locks[i]);
+}
+
+static void ram_range_write_lock(u64 pos, u64 len) {
+    unsigned int i, last;
+
+    for (ram_stripe_range(pos, len, &i, &last); i <= last; i++)
+        write_lock(&ram_stripe_locks[i]);
+}
+
+static void ram_range_write_unlock(u64 pos, u64 len) {
+    unsigned int i, last;
+
+    for (ram_stripe_range(pos, len, &i, &last); i <= last; i++)
+        write_unlock(&ram_stripe_locks[i]);
+}
+
+static void ram_stripes_init(void) {
+    int i;
+
+    ram_stripe_shift = max_t(unsigned int, PAGE_SHIFT,
+                             order_base_2(DIV_ROUND_UP(buffer_size, RAM_STRIPES)));
+    for (i = 0; i < RAM_STRIPES; i++) {
+        rwlock_init(&ram_stripe_locks[i]);
+        lockdep_set_class(&ram_stripe_locks[i], &ram_stripe_keys[i]);
+    }
+}
+
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 opens;
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array6/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.opens += s->opens;
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "opens:         %llu\n", sum.opens);
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+/*
+ * Optional latency histograms, one per operation and phase. "lock_wait" is
+ * the time spent acquiring the device lock, "run" is the time spent holding
+ * it (or, for unlocked paths, copying). Bucket b counts samples in
+ * [2^(b-1), 2^b) ns; the last bucket also takes everything slower.
+ */
+static bool latency_hist;
+module_param(latency_hist, bool, 0644);
+MODULE_PARM_DESC(latency_hist, "Record per-operation latency histograms in debugfs (default off)");
+
+enum ram_lat_op { RAM_LAT_OPEN, RAM_LAT_READ, RAM_LAT_WRITE, RAM_LAT_IOCTL, RAM_LAT_NR_OPS };
+enum ram_lat_phase { RAM_LAT_WAIT, RAM_LAT_RUN, RAM_LAT_NR_PHASES };
+#define RAM_LAT_BUCKETS 32
+
+static const char * const ram_lat_op_names[RAM_LAT_NR_OPS] = { "open", "read", "write", "ioctl" };
+static const char * const ram_lat_phase_names[RAM_LAT_NR_PHASES] = { "lock_wait", "run" };
+
+struct ram_latency {
+    u64 hist[RAM_LAT_NR_OPS][RAM_LAT_NR_PHASES][RAM_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct ram_latency, ram_latency);
+
+// Returns a start timestamp, or 0 when histograms are off
+static inline u64 ram_lat_start(void) {
+    return READ_ONCE(latency_hist) ? ktime_get_ns() : 0;
+}
+
+// Records the phase that began at 'start' and returns the end time, so the next phase can chain from it
+static inline u64 ram_lat_record(int op, int phase, u64 start) {
+    u64 now;
+
+    if (!start)
+        return 0;
+    now = ktime_get_ns();
+    this_cpu_inc(ram_latency.hist[op][phase][min(fls64(now - start), RAM_LAT_BUCKETS - 1)]);
+    return now;
+}
+
+// debugfs: <debugfs>/ram_array6/latency, summed over all CPUs on read; any write resets it
+static int ram_latency_show(struct seq_file *m, void *v) {
+    u64 sum[RAM_LAT_BUCKETS];
+    int op, phase, b, cpu;
+
+    for (op = 0; op < RAM_LAT_NR_OPS; op++) {
+        for (phase = 0; phase < RAM_LAT_NR_PHASES; phase++) {
+            u64 total = 0;
+
+            memset(sum, 0, sizeof(sum));
+            for_each_possible_cpu(cpu) {
+                struct ram_latency *l = per_cpu_ptr(&ram_latency, cpu);
+
+                for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                    sum[b] += l->hist[op][phase][b];
+            }
+            for (b = 0; b < RAM_LAT_BUCKETS; b++)
+                total += sum[b];
+            if (!total)
+                continue;
+
+            seq_printf(m, "%s %s: %llu samples\n", ram_lat_op_names[op], ram_lat_phase_names[phase], total);
+            for (b = 0; b < RAM_LAT_BUCKETS; b++) {
+                if (!sum[b])
+                    continue;
+                if (b == RAM_LAT_BUCKETS - 1)
+                    seq_printf(m, "  >= %10llu ns: %llu\n", 1ULL << (b - 1), sum[b]);
+                else
+                    seq_printf(m, "  <  %10llu ns: %llu\n", 1ULL << b, sum[b]);
+            }
+        }
+    }
+    return 0;
+}
+
+static int ram_latency_open(struct inode *inode, struct file *file) {
+    return single_open(file, ram_latency_show, inode->i_private);
+}
+
+static ssize_t ram_latency_reset(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&ram_latency, cpu), 0, sizeof(struct ram_latency));
+    return count;
+}
+
+static const struct file_operations ram_latency_fops = {
+    .owner = THIS_MODULE,
+    .open = ram_latency_open,
+    .read = seq_read,
+    .write = ram_latency_reset,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/*
+ * Count vowels eight bytes at a time (SWAR). OR-ing 0x20 into every byte
+ * folds 'A'..'Z' onto 'a'..'z' and maps nothing else onto a lowercase vowel,
+ * so each vowel needs one XOR plus an exact zero-byte test per word instead
+ * of ten compares per byte.
+ */
+#define RAM_ONES (~0ULL / 0xff)  // 0x0101010101010101
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+// 0x80 in every byte of x that is zero, without false positives from borrows
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t ram_count_vowels(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    // Head bytes up to the first aligned word
+    while (len && !IS_ALIGNED((unsigned long)buf, sizeof(u64))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += hweight64(hits);
+    }
+
+    // Tail bytes
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
+
+static u32 *ram_page_crc;  // One CRC-32C per page when page_csums is set, kept under the page's stripe lock
+
+static u32 ram_page_crc_of(size_t page) {
+    size_t off = page << PAGE_SHIFT;
+
+    return ~crc32c(~0U, ram_array + off, min_t(size_t, PAGE_SIZE, buffer_size - off));
+}
+
+// Refresh the checksum of every page touched by [pos, pos + len)
+static void ram_update_page_csums(size_t pos, size_t len) {
+    size_t page;
+
+    if (!ram_page_crc || !len)
+        return;
+    for (page = pos >> PAGE_SHIFT; page <= (pos + len - 1) >> PAGE_SHIFT; page++)
+        ram_page_crc[page] = ram_page_crc_of(page);
+}
+
+/*
+ * Zero [pos, pos + len) a page at a time, taking only that page's stripe lock
+ * and rescheduling in between, so a multi-gigabyte clear never keeps other
+ * CPUs spinning. Readers may see a partly cleared range while it runs.
+ */
+static void ram_clear_range(u64 pos, u64 len) {
+    size_t n;
+
+    u64 start;
+
+    for (; len; pos += n, len -= n) {
+        n = min_t(u64, len, PAGE_SIZE - offset_in_page(pos));
+        start = ram_lat_start();
+        ram_range_write_lock(pos, n);
+        start = ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_WAIT, start);
+        atomic_long_sub(ram_count_vowels(ram_array + pos, n), &ram_vowels);
+        memset(ram_array + pos, 0, n);
+        ram_update_page_csums(pos, n);
+        ram_range_write_unlock(pos, n);
+        ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+        cond_resched();
+    }
+}
 
 // Function prototypes
 static int ram_open(struct inode *inode, struct file *file);
 static int ram_release(struct inode *inode, struct file *file);
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos);
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos);
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from);
 static loff_t ram_seek(struct file *file, loff_t offset, int whence);
 static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int ram_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+static int ram_mmap(struct file *file, struct vm_area_struct *vma);
+struct ram_ring;
+static void ram_ring_free(struct ram_ring *ring);
+static int ram_ring_mmap(struct file *file, struct vm_area_struct *vma);
 
 static struct file_operations ram_fops = {
     .owner = THIS_MODULE,
     .open = ram_open,
     .release = ram_release,
-    .read = ram_read,
-    .write = ram_write,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
     .llseek = ram_seek,
+    .splice_read = copy_splice_read,        // sendfile()/splice() out of the device
+    .splice_write = iter_file_splice_write, // splice() into the device
     .unlocked_ioctl = ram_ioctl,
+    .uring_cmd = ram_uring_cmd,             // ioctl commands through io_uring
+    .mmap = ram_mmap,
 };
 
 static int ram_open(struct inode *inode, struct file *file) {
     printk(KERN_INFO "ram_array: Device opened\n");
+    ram_stat_inc(opens);
     return 0;
 }
 
 static int ram_release(struct inode *inode, struct file *file) {
+    if (file->private_data)
+        ram_ring_free(file->private_data);
     printk(KERN_INFO "ram_array: Device released\n");
     return 0;
 }
 
-static ssize_t ram_read(struct file *file, char __user *buf, size_t count, loff_t *pos) {
-    ssize_t ret;
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied = 0, n, w;
+    u64 start;
 
-    if (*pos >= BUFFER_SIZE)
+    if (pos >= buffer_size)
         return 0;
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
 
-    read_lock(&ram_rwlock);
-    ret = copy_to_user(buf, ram_array + *pos, count) ? -EFAULT : count;
-    read_unlock(&ram_rwlock);
+    /*
+     * The vector is copied RAM_BATCH_WINDOW bytes at a time, each window under
+     * the read locks of the stripes it covers, with a reschedule in between.
+     * rwlock_t spins, so user pages cannot be faulted in while they are held:
+     * copy with page faults disabled and, if that comes up short, fault the
+     * rest of the window in outside the locks and retry.
+     */
+    while (copied < count) {
+        w = min_t(size_t, count - copied, RAM_BATCH_WINDOW);
+        start = ram_lat_start();
+        ram_range_read_lock(pos + copied, w);
+        start = ram_lat_record(RAM_LAT_READ, RAM_LAT_WAIT, start);
+        pagefault_disable();
+        n = copy_to_iter(ram_array + pos + copied, w, to);
+        pagefault_enable();
+        ram_range_read_unlock(pos + copied, w);
+        ram_lat_record(RAM_LAT_READ, RAM_LAT_RUN, start);
 
-    if (ret >= 0) {
-        *pos += ret;
-        printk(KERN_INFO "ram_array: Read %zu bytes from position %lld\n", count, *pos);
+        copied += n;
+        if (n < w && fault_in_iov_iter_writeable(to, w - n) == w - n)
+            break;
+        cond_resched();
     }
-    return ret;
+
+    if (!copied && count) {
+        ram_stat_inc(efaults);
+        return -EFAULT;
+    }
+
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    trace_ram_read(copied, pos);
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    return copied;
 }
 
-static ssize_t ram_write(struct file *file, const char __user *buf, size_t count, loff_t *pos) {
-    ssize_t ret;
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied = 0, n, w;
+    long old;
+    u64 start;
 
-    if (*pos >= BUFFER_SIZE)
+    if (pos >= buffer_size)
         return 0;
-    if (*pos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *pos;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
 
-    write_lock(&ram_rwlock);
-    ret = copy_from_user(ram_array + *pos, buf, count) ? -EFAULT : count;
-    write_unlock(&ram_rwlock);
+    // Same scheme as ram_read_iter(), with the stripes' write locks
+    while (copied < count) {
+        w = min_t(size_t, count - copied, RAM_BATCH_WINDOW);
+        start = ram_lat_start();
+        ram_range_write_lock(pos + copied, w);
+        start = ram_lat_record(RAM_LAT_WRITE, RAM_LAT_WAIT, start);
+        old = ram_count_vowels(ram_array + pos + copied, w);
+        pagefault_disable();
+        n = copy_from_iter(ram_array + pos + copied, w, from);
+        pagefault_enable();
+        // Bytes past 'n' are unchanged, so they cancel out of the difference
+        atomic_long_add((long)ram_count_vowels(ram_array + pos + copied, w) - old, &ram_vowels);
+        ram_update_page_csums(pos + copied, n);
+        ram_range_write_unlock(pos + copied, w);
+        ram_lat_record(RAM_LAT_WRITE, RAM_LAT_RUN, start);
 
-    if (ret >= 0) {
-        *pos += ret;
-        printk(KERN_INFO "ram_array: Wrote %zu bytes at position %lld\n", count, *pos);
+        copied += n;
+        if (n < w && fault_in_iov_iter_readable(from, w - n) == w - n)
+            break;
+        cond_resched();
     }
-    return ret;
+
+    if (!copied && count) {
+        ram_stat_inc(efaults);
+        return -EFAULT;
+    }
+
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    trace_ram_write(copied, pos);
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    return copied;
 }
 
 static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
@@ -89,52 +483,1054 @@ static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
     switch (whence) {
         case SEEK_SET: new_pos = offset; break;
         case SEEK_CUR: new_pos = file->f_pos + offset; break;
-        case SEEK_END: new_pos = BUFFER_SIZE + offset; break;
+        case SEEK_END: new_pos = buffer_size + offset; break;
         default: return -EINVAL;
     }
 
-    if (new_pos < 0 || new_pos > BUFFER_SIZE) return -EINVAL;
+    if (new_pos < 0 || new_pos > buffer_size) return -EINVAL;
+    trace_ram_seek(new_pos);
     file->f_pos = new_pos;
     return new_pos;
 }
 
-static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    int count = 0, i;
-    int buffer_size = BUFFER_SIZE;
+// Fault handler: map the vmalloc page backing the faulting offset
+static vm_fault_t ram_vm_fault(struct vm_fault *vmf) {
+    unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+    struct page *page;
+
+    if (offset >= buffer_size)
+        return VM_FAULT_SIGBUS;
+
+    page = vmalloc_to_page(ram_array + offset);
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static const struct vm_operations_struct ram_vm_ops = {
+    .fault = ram_vm_fault,
+};
+
+static int ram_mmap(struct file *file, struct vm_area_struct *vma) {
+    unsigned long pages = PAGE_ALIGN(buffer_size) >> PAGE_SHIFT;
+
+    if (vma->vm_pgoff == RAM_RING_OFF >> PAGE_SHIFT)
+        return ram_ring_mmap(file, vma);
+
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+        return -EINVAL;
+
+    // Stores through a shared mapping would bypass the stripe locks, so shared mappings are read-only
+    if (vma->vm_flags & VM_SHARED) {
+        if (vma->vm_flags & VM_WRITE)
+            return -EACCES;
+        vm_flags_clear(vma, VM_MAYWRITE);
+    }
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &ram_vm_ops;
+    return 0;
+}
+
+/*
+ * RAM_BYTE_HIST: 256-bin byte histogram of [offset, offset + length) in one
+ * pass, plus the number of bytes whose value is set in class_map. length 0
+ * means "to the end of the buffer".
+ */
+struct ram_hist_req {
+    __u64 offset;
+    __u64 length;
+    __u8 class_map[32];     // Bit b set: byte value b belongs to the class
+    __u64 class_count;      // Out: bytes in the class
+    __u64 hist[256];        // Out: occurrences of each byte value
+};
+
+/*
+ * Four interleaved u32 tables, so runs of the same byte do not serialize on
+ * one counter. They are folded into the u64 result after every chunk, long
+ * before they could overflow.
+ */
+struct ram_hist_work {
+    struct ram_hist_req req;
+    u32 lanes[4][256];
+};
+
+static void ram_byte_hist(const u8 *buf, size_t len, struct ram_hist_work *w) {
+    size_t i;
+    int b;
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        w->lanes[0][buf[i]]++;
+        w->lanes[1][buf[i + 1]]++;
+        w->lanes[2][buf[i + 2]]++;
+        w->lanes[3][buf[i + 3]]++;
+    }
+    for (; i < len; i++)
+        w->lanes[0][buf[i]]++;
+
+    for (b = 0; b < 256; b++)
+        w->req.hist[b] += (u64)w->lanes[0][b] + w->lanes[1][b] + w->lanes[2][b] + w->lanes[3][b];
+    memset(w->lanes, 0, sizeof(w->lanes));
+}
+
+/*
+ * Parallel scan engine. A range is cut into scan_chunk_size pieces; up to one
+ * worker per online CPU claims pieces from a shared counter, scans each one
+ * under the read side of the device lock, and keeps its own partial result.
+ * The caller runs the first worker itself and merges everything at the end.
+ */
+#define RAM_SCAN_CHUNK_MAX (1UL << 30)  // Keeps each u32 lane of a byte histogram far from overflow
+
+static unsigned long scan_chunk_size = 1 << 20;
+
+static int ram_scan_chunk_set(const char *val, const struct kernel_param *kp) {
+    unsigned long size;
+    int ret = kstrtoul(val, 0, &size);
+
+    if (ret)
+        return ret;
+    // Zero would never advance the chunk counter
+    if (size < PAGE_SIZE || size > RAM_SCAN_CHUNK_MAX)
+        return -EINVAL;
+    WRITE_ONCE(scan_chunk_size, size);
+    return 0;
+}
+
+static const struct kernel_param_ops ram_scan_chunk_ops = {
+    .set = ram_scan_chunk_set,
+    .get = param_get_ulong,
+};
+module_param_cb(scan_chunk_size, &ram_scan_chunk_ops, &scan_chunk_size, 0644);
+MODULE_PARM_DESC(scan_chunk_size, "Bytes per work item in parallel buffer scans (default 1 MiB, minimum one page, maximum 1 GiB)");
+
+static struct workqueue_struct *ram_scan_wq;
+
+enum ram_scan_op { RAM_SCAN_VOWELS, RAM_SCAN_HIST };
+
+struct ram_scan {
+    enum ram_scan_op op;
+    size_t offset;
+    size_t len;
+    size_t chunk;
+    atomic_long_t next;     // Next chunk to claim
+};
+
+struct ram_scan_worker {
+    struct work_struct work;
+    struct ram_scan *scan;
+    size_t vowels;
+    struct ram_hist_work hist;
+};
+
+static void ram_scan_chunk(struct ram_scan_worker *w, size_t offset, size_t len) {
+    u64 start = ram_lat_start();
+
+    ram_range_read_lock(offset, len);
+    start = ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_WAIT, start);
+    if (w->scan->op == RAM_SCAN_VOWELS)
+        w->vowels += ram_count_vowels(ram_array + offset, len);
+    else
+        ram_byte_hist((const u8 *)ram_array + offset, len, &w->hist);
+    ram_range_read_unlock(offset, len);
+    ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+}
+
+static void ram_scan_work_fn(struct work_struct *work) {
+    struct ram_scan_worker *w = container_of(work, struct ram_scan_worker, work);
+    struct ram_scan *scan = w->scan;
+    size_t nr = DIV_ROUND_UP(scan->len, scan->chunk);
+    size_t i, off;
+
+    while ((i = atomic_long_inc_return(&scan->next) - 1) < nr) {
+        off = i * scan->chunk;
+        ram_scan_chunk(w, scan->offset + off, min(scan->chunk, scan->len - off));
+        cond_resched();
+    }
+}
+
+/*
+ * Scan [offset, offset + len) into 'out'. With parallel false, or when the
+ * range fits in one chunk, everything runs on the calling thread.
+ */
+static void ram_scan_run(enum ram_scan_op op, size_t offset, size_t len, bool parallel,
+                         struct ram_scan_worker *out) {
+    struct ram_scan scan = {
+        .op = op,
+        .offset = offset,
+        .len = len,
+        .chunk = READ_ONCE(scan_chunk_size),
+        .next = ATOMIC_LONG_INIT(0),
+    };
+    struct ram_scan_worker *workers = NULL;
+    size_t nr = 1, i;
+    int b;
+
+    if (parallel)
+        nr = min_t(size_t, num_online_cpus(), DIV_ROUND_UP(len, scan.chunk));
+    if (nr > 1)
+        workers = kvcalloc(nr - 1, sizeof(*workers), GFP_KERNEL);
+    if (!workers)
+        nr = 1;  // Serial, or not enough memory for the workers
+
+    for (i = 0; i < nr - 1; i++) {
+        workers[i].scan = &scan;
+        INIT_WORK(&workers[i].work, ram_scan_work_fn);
+        queue_work(ram_scan_wq, &workers[i].work);
+    }
+
+    out->scan = &scan;
+    ram_scan_work_fn(&out->work);
+
+    for (i = 0; i < nr - 1; i++) {
+        flush_work(&workers[i].work);
+        out->vowels += workers[i].vowels;
+        if (op == RAM_SCAN_HIST)
+            for (b = 0; b < 256; b++)
+                out->hist.req.hist[b] += workers[i].hist.req.hist[b];
+    }
+    kvfree(workers);
+}
+
+static long ram_byte_hist_ioctl(struct ram_hist_req __user *ureq) {
+    struct ram_scan_worker *res;
+    struct ram_hist_req *req;
+    long ret = 0;
+    int b;
+
+    res = kzalloc(sizeof(*res), GFP_KERNEL);
+    if (!res)
+        return -ENOMEM;
+    req = &res->hist.req;
+    if (copy_from_user(req, ureq, offsetof(struct ram_hist_req, class_count))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    if (req->offset > buffer_size || req->length > buffer_size - req->offset) {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (!req->length)
+        req->length = buffer_size - req->offset;
+
+    ram_scan_run(RAM_SCAN_HIST, req->offset, req->length, true, res);
+
+    for (b = 0; b < 256; b++)
+        if (req->class_map[b / 8] & (1 << (b % 8)))
+            req->class_count += req->hist[b];
+
+    if (copy_to_user(ureq, req, sizeof(*req)))
+        ret = -EFAULT;
+    else
+        trace_ram_ioctl(RAM_BYTE_HIST, req->class_count);
+out:
+    kfree(res);
+    return ret;
+}
+
+// debugfs: <debugfs>/ram_array6/scan_bench counts the vowels in the whole buffer serially and in parallel
+static int ram_scan_bench_show(struct seq_file *m, void *v) {
+    struct ram_scan_worker *res;
+    u64 t0, serial, parallel;
+    size_t vowels;
+
+    res = kzalloc(sizeof(*res), GFP_KERNEL);
+    if (!res)
+        return -ENOMEM;
+
+    t0 = ktime_get_ns();
+    ram_scan_run(RAM_SCAN_VOWELS, 0, buffer_size, false, res);
+    serial = ktime_get_ns() - t0;
+    vowels = res->vowels;
+
+    memset(res, 0, sizeof(*res));
+    t0 = ktime_get_ns();
+    ram_scan_run(RAM_SCAN_VOWELS, 0, buffer_size, true, res);
+    parallel = ktime_get_ns() - t0;
+
+    seq_printf(m, "buffer_size:  %lu\n", buffer_size);
+    seq_printf(m, "chunk_size:   %lu\n", READ_ONCE(scan_chunk_size));
+    seq_printf(m, "online_cpus:  %u\n", num_online_cpus());
+    seq_printf(m, "serial_ns:    %llu (%zu vowels)\n", serial, vowels);
+    seq_printf(m, "parallel_ns:  %llu (%zu vowels)\n", parallel, res->vowels);
+    seq_printf(m, "speedup:      %llu.%02llu\n", serial / max(parallel, 1ULL),
+               serial * 100 / max(parallel, 1ULL) % 100);
+    kfree(res);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_scan_bench);
+
+/*
+ * RAM_SEARCH: offsets of a byte pattern within [offset, offset + length),
+ * found with the kernel textsearch infrastructure. length 0 means "to the
+ * end of the buffer". At most max_matches offsets are written to 'matches'.
+ */
+struct ram_search_req {
+    __u64 offset;
+    __u64 length;
+    __u64 pattern;          // User pointer to the pattern bytes
+    __u64 matches;          // User pointer to a __u64 array of max_matches entries
+    __u32 pattern_len;
+    __u32 max_matches;
+    __u32 nr_matches;       // Out: offsets written to 'matches'
+    __u32 flags;            // RAM_SEARCH_*
+};
+
+#define RAM_SEARCH_ICASE 0x1    // Case-insensitive match
+#define RAM_SEARCH_KMP 0x2      // Knuth-Morris-Pratt instead of Boyer-Moore
+
+#define RAM_SEARCH_MAX_PATTERN 256
+#define RAM_SEARCH_WINDOW (1 << 20) // Bytes searched per lock hold
+#define RAM_SEARCH_BATCH 512        // Offsets gathered per lock hold, then copied out
+
+static long ram_search_ioctl(struct ram_search_req __user *ureq) {
+    struct ram_search_req req;
+    struct ts_config *conf;
+    struct ts_state state;
+    u64 __user *umatches;
+    u64 *batch;
+    u64 pos, end, start;
+    unsigned int m, n;
+    void *pattern;
+    long ret = 0;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (!req.pattern_len || req.pattern_len > RAM_SEARCH_MAX_PATTERN ||
+        req.flags & ~(RAM_SEARCH_ICASE | RAM_SEARCH_KMP))
+        return -EINVAL;
+    if (req.offset > buffer_size || req.length > buffer_size - req.offset)
+        return -EINVAL;
+    if (!req.length)
+        req.length = buffer_size - req.offset;
+
+    pattern = memdup_user(u64_to_user_ptr(req.pattern), req.pattern_len);
+    if (IS_ERR(pattern))
+        return PTR_ERR(pattern);
+
+    // Preparing may allocate and load ts_bm/ts_kmp, so do it before taking the lock
+    conf = textsearch_prepare(req.flags & RAM_SEARCH_KMP ? "kmp" : "bm", pattern, req.pattern_len,
+                              GFP_KERNEL, TS_AUTOLOAD |
+                              (req.flags & RAM_SEARCH_ICASE ? TS_IGNORECASE : 0));
+    kfree(pattern);
+    if (IS_ERR(conf))
+        return PTR_ERR(conf);
+
+    batch = kmalloc_array(RAM_SEARCH_BATCH, sizeof(*batch), GFP_KERNEL);
+    if (!batch) {
+        textsearch_destroy(conf);
+        return -ENOMEM;
+    }
+
+    umatches = u64_to_user_ptr(req.matches);
+    req.nr_matches = 0;
+    pos = req.offset;
+    end = req.offset + req.length;
+
+    /*
+     * Search a window at a time, overlapping the next one by pattern_len - 1
+     * bytes so matches across the boundary are not lost. Only matches that
+     * start inside the window proper are taken; the rest belong to the next.
+     */
+    while (pos < end && req.nr_matches < req.max_matches) {
+        u64 win = min_t(u64, end - pos, RAM_SEARCH_WINDOW + req.pattern_len - 1);
+        u64 next = pos + RAM_SEARCH_WINDOW;
+
+        n = 0;
+        start = ram_lat_start();
+        ram_range_read_lock(pos, win);
+        start = ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_WAIT, start);
+        m = textsearch_find_continuous(conf, &state, ram_array + pos, win);
+        while (m != UINT_MAX && m < RAM_SEARCH_WINDOW) {
+            batch[n++] = pos + m;
+            if (n == RAM_SEARCH_BATCH || req.nr_matches + n == req.max_matches) {
+                next = pos + m + 1;  // Resume right after the last match taken
+                break;
+            }
+            m = textsearch_next(conf, &state);
+        }
+        ram_range_read_unlock(pos, win);
+        ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+
+        if (copy_to_user(umatches + req.nr_matches, batch, n * sizeof(*batch))) {
+            ret = -EFAULT;
+            goto out;
+        }
+        req.nr_matches += n;
+        pos = next;
+        cond_resched();
+    }
+
+    if (put_user(req.nr_matches, &ureq->nr_matches))
+        ret = -EFAULT;
+    else
+        trace_ram_ioctl(RAM_SEARCH, req.nr_matches);
+out:
+    kfree(batch);
+    textsearch_destroy(conf);
+    return ret;
+}
+
+/*
+ * RAM_CHECKSUM: CRC-32C or xxHash64 of [offset, offset + length), so an
+ * integrity check does not have to copy the data out. length 0 means "to the
+ * end of the buffer". crc32c() uses the SSE4.2 instruction where available.
+ */
+struct ram_csum_req {
+    __u64 offset;
+    __u64 length;
+    __u32 algo;             // RAM_CSUM_*
+    __u32 reserved;
+    __u64 csum;             // Out
+};
+
+#define RAM_CSUM_CRC32C 0   // Standard CRC-32C (Castagnoli)
+#define RAM_CSUM_XXH64 1    // xxHash64, seed 0
+
+#define RAM_CSUM_WINDOW (1 << 20)   // Bytes checksummed per lock hold
+
+static long ram_csum_ioctl(struct ram_csum_req __user *ureq) {
+    struct ram_csum_req req;
+    struct xxh64_state xxh;
+    u32 crc = ~0U;
+    u64 pos, end, n, start;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (req.algo > RAM_CSUM_XXH64)
+        return -EINVAL;
+    if (req.offset > buffer_size || req.length > buffer_size - req.offset)
+        return -EINVAL;
+    if (!req.length)
+        req.length = buffer_size - req.offset;
+
+    // Both algorithms are incremental, so the lock is only held for a window at a time
+    xxh64_reset(&xxh, 0);
+    for (pos = req.offset, end = req.offset + req.length; pos < end; pos += n) {
+        n = min_t(u64, end - pos, RAM_CSUM_WINDOW);
+        start = ram_lat_start();
+        ram_range_read_lock(pos, n);
+        start = ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_WAIT, start);
+        if (req.algo == RAM_CSUM_CRC32C)
+            crc = crc32c(crc, ram_array + pos, n);
+        else
+            xxh64_update(&xxh, ram_array + pos, n);
+        ram_range_read_unlock(pos, n);
+        ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+        cond_resched();
+    }
+
+    req.csum = req.algo == RAM_CSUM_CRC32C ? ~crc : xxh64_digest(&xxh);
+    if (put_user(req.csum, &ureq->csum))
+        return -EFAULT;
+    trace_ram_ioctl(RAM_CHECKSUM, req.csum);
+    return 0;
+}
+
+/*
+ * RAM_PAGE_CSUMS: the per-page CRC-32Cs kept by the write path (page_csums=1).
+ * Comparing them with an earlier copy shows which pages changed at a cost of
+ * four bytes per page. nr_pages 0 means "to the last page".
+ */
+struct ram_page_csums_req {
+    __u64 first_page;
+    __u64 nr_pages;
+    __u64 csums;            // User pointer to a __u32 array of nr_pages entries
+};
+
+#define RAM_CSUM_BATCH 1024 // Checksums copied out per lock hold
+
+static long ram_page_csums_ioctl(struct ram_page_csums_req __user *ureq) {
+    struct ram_page_csums_req req;
+    u64 nr_pages = DIV_ROUND_UP(buffer_size, PAGE_SIZE);
+    u32 __user *ucsums;
+    u32 *batch;
+    u64 done, n;
+    long ret = 0;
+
+    if (!ram_page_crc)
+        return -EOPNOTSUPP;
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (req.first_page > nr_pages || req.nr_pages > nr_pages - req.first_page)
+        return -EINVAL;
+    if (!req.nr_pages)
+        req.nr_pages = nr_pages - req.first_page;
+
+    batch = kmalloc_array(RAM_CSUM_BATCH, sizeof(*batch), GFP_KERNEL);
+    if (!batch)
+        return -ENOMEM;
+
+    ucsums = u64_to_user_ptr(req.csums);
+    for (done = 0; done < req.nr_pages; done += n) {
+        n = min_t(u64, req.nr_pages - done, RAM_CSUM_BATCH);
+        ram_range_read_lock((req.first_page + done) << PAGE_SHIFT, n << PAGE_SHIFT);
+        memcpy(batch, ram_page_crc + req.first_page + done, n * sizeof(*batch));
+        ram_range_read_unlock((req.first_page + done) << PAGE_SHIFT, n << PAGE_SHIFT);
+        if (copy_to_user(ucsums + done, batch, n * sizeof(*batch))) {
+            ret = -EFAULT;
+            goto out;
+        }
+    }
+
+    if (put_user(req.nr_pages, &ureq->nr_pages))
+        ret = -EFAULT;
+out:
+    kfree(batch);
+    return ret;
+}
+
+/*
+ * RAM_BATCH: run an array of small operations with one ioctl and, unless a
+ * user page has to be faulted in, one lock acquisition. Each op gets its own
+ * result: bytes moved, a count or a checksum, or a negative errno.
+ */
+struct ram_batch_op {
+    __u32 opcode;           // RAM_OP_*
+    __u32 reserved;
+    __u64 offset;
+    __u64 length;
+    __u64 buf;              // User buffer for RAM_OP_READ/RAM_OP_WRITE
+    __s64 result;           // Out
+};
+
+struct ram_batch {
+    __u64 ops;              // User pointer to nr_ops struct ram_batch_op
+    __u32 nr_ops;
+    __u32 nr_done;          // Out
+};
+
+#define RAM_OP_READ 0           // pread: copy [offset, offset + length) to buf
+#define RAM_OP_WRITE 1          // pwrite: copy buf to [offset, offset + length)
+#define RAM_OP_CLEAR 2          // Zero [offset, offset + length)
+#define RAM_OP_COUNT_VOWELS 3   // Vowels in [offset, offset + length)
+#define RAM_OP_CRC32C 4         // CRC-32C of [offset, offset + length)
+
+#define RAM_BATCH_MAX 1024
+#define RAM_BATCH_OP_MAX (1 << 20)      // Longest single op; longer ones fail with -EINVAL
+
+static bool ram_batch_op_writes(const struct ram_batch_op *op) {
+    return op->opcode == RAM_OP_WRITE || op->opcode == RAM_OP_CLEAR;
+}
+
+/*
+ * Runs with the lock held and page faults disabled. Returns -EAGAIN if a user
+ * page is not resident; the caller faults it in and runs the op again.
+ */
+static int ram_batch_run_op(struct ram_batch_op *op) {
+    void __user *ubuf = u64_to_user_ptr(op->buf);
+    char *p = ram_array + op->offset;
+    unsigned long left;
+    long old;
+
+    if (op->offset > buffer_size || op->length > buffer_size - op->offset ||
+        op->length > RAM_BATCH_OP_MAX) {
+        op->result = -EINVAL;
+        return 0;
+    }
+    if ((op->opcode == RAM_OP_READ || op->opcode == RAM_OP_WRITE) &&
+        !access_ok(ubuf, op->length)) {
+        op->result = -EFAULT;
+        return 0;
+    }
+
+    switch (op->opcode) {
+        case RAM_OP_READ:
+            if (__copy_to_user_inatomic(ubuf, p, op->length))
+                return -EAGAIN;
+            ram_stat_add(bytes_read, op->length);
+            op->result = op->length;
+            break;
+
+        case RAM_OP_WRITE:
+            // Account for whatever was copied even if the copy comes up short
+            old = ram_count_vowels(p, op->length);
+            left = __copy_from_user_inatomic(p, ubuf, op->length);
+            atomic_long_add((long)ram_count_vowels(p, op->length) - old, &ram_vowels);
+            ram_update_page_csums(op->offset, op->length);
+            if (left)
+                return -EAGAIN;
+            ram_stat_add(bytes_written, op->length);
+            op->result = op->length;
+            break;
+
+        case RAM_OP_CLEAR:
+            atomic_long_sub(ram_count_vowels(p, op->length), &ram_vowels);
+            memset(p, 0, op->length);
+            ram_update_page_csums(op->offset, op->length);
+            op->result = op->length;
+            break;
+
+        case RAM_OP_COUNT_VOWELS:
+            op->result = ram_count_vowels(p, op->length);
+            break;
+
+        case RAM_OP_CRC32C:
+            op->result = ~crc32c(~0U, p, op->length);
+            break;
+
+        default:
+            op->result = -EINVAL;
+    }
+    return 0;
+}
+
+// Fault in the user buffer of an op that hit a non-resident page
+static int ram_batch_fault_in(struct ram_batch_op *op) {
+    char __user *ubuf = u64_to_user_ptr(op->buf);
+
+    if (op->opcode == RAM_OP_READ)
+        return fault_in_writeable(ubuf, op->length) ? -EFAULT : 0;
+    return fault_in_readable(ubuf, op->length) ? -EFAULT : 0;
+}
+
+static long ram_batch_ioctl(struct ram_batch __user *ubatch) {
+    struct ram_batch batch;
+    struct ram_batch_op *ops;
+    bool writes = false;
+    u32 i = 0, j;
+    u64 start;
+    long ret = 0;
+
+    if (copy_from_user(&batch, ubatch, sizeof(batch)))
+        return -EFAULT;
+    if (!batch.nr_ops || batch.nr_ops > RAM_BATCH_MAX)
+        return -EINVAL;
+
+    ops = kvmalloc_array(batch.nr_ops, sizeof(*ops), GFP_KERNEL);
+    if (!ops)
+        return -ENOMEM;
+    if (copy_from_user(ops, u64_to_user_ptr(batch.ops), batch.nr_ops * sizeof(*ops))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    // Batches that only read can share the lock with other readers
+    for (j = 0; j < batch.nr_ops; j++)
+        writes |= ram_batch_op_writes(&ops[j]);
+
+    while (i < batch.nr_ops) {
+        size_t held = 0;
+        bool fault = false;
+
+        start = ram_lat_start();
+        if (writes)
+            ram_range_write_lock(0, buffer_size);
+        else
+            ram_range_read_lock(0, buffer_size);
+        start = ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_WAIT, start);
+        pagefault_disable();
+        // Ops are capped at RAM_BATCH_OP_MAX, so the locks are held for at most two windows
+        while (i < batch.nr_ops) {
+            if (ram_batch_run_op(&ops[i]) == -EAGAIN) {
+                fault = true;
+                break;
+            }
+            held += min_t(u64, ops[i].length, RAM_BATCH_OP_MAX);
+            i++;
+            if (held >= RAM_BATCH_WINDOW || need_resched())
+                break;
+        }
+        pagefault_enable();
+        if (writes)
+            ram_range_write_unlock(0, buffer_size);
+        else
+            ram_range_read_unlock(0, buffer_size);
+        ram_lat_record(RAM_LAT_IOCTL, RAM_LAT_RUN, start);
+
+        // A user page was missing: fault it in without the lock and resume at that op
+        if (fault && ram_batch_fault_in(&ops[i])) {
+            ops[i].result = -EFAULT;
+            i++;
+        }
+        cond_resched();
+    }
+
+    if (copy_to_user(u64_to_user_ptr(batch.ops), ops, batch.nr_ops * sizeof(*ops)) ||
+        put_user(batch.nr_ops, &ubatch->nr_done))
+        ret = -EFAULT;
+    else
+        trace_ram_ioctl(RAM_BATCH, batch.nr_ops);
+out:
+    kvfree(ops);
+    return ret;
+}
+
+/*
+ * Submission/completion rings. RAM_RING_SETUP allocates, per open file, one
+ * vmalloc_user() area that user space maps at RAM_RING_OFF:
+ *
+ *   [ struct ram_ring_hdr | SQ: ram_sqe[entries] | CQ: ram_cqe[entries] | data ]
+ *
+ * User space fills SQEs, publishes them by advancing sq_tail, and reaps CQEs
+ * between cq_head and cq_tail. READ/WRITE payloads live in the data area,
+ * addressed by offset, so the driver never touches user pointers. SQEs are
+ * consumed on RAM_RING_ENTER (the doorbell) or, with RAM_RING_SQPOLL, by a
+ * kthread that busy-polls sq_tail and sets RAM_RING_NEED_WAKEUP before it
+ * goes to sleep.
+ */
+struct ram_ring_hdr {
+    __u32 sq_head;          // Written by the driver
+    __u32 pad0[15];
+    __u32 sq_tail;          // Written by user space
+    __u32 pad1[15];
+    __u32 cq_head;          // Written by user space
+    __u32 pad2[15];
+    __u32 cq_tail;          // Written by the driver
+    __u32 pad3[15];
+    __u32 entries;
+    __u32 flags;            // RAM_RING_NEED_WAKEUP
+};
+
+struct ram_sqe {
+    __u32 opcode;           // RAM_OP_READ, RAM_OP_WRITE, RAM_OP_CLEAR, RAM_OP_COUNT_VOWELS, RAM_OP_CRC32C
+    __u32 reserved;
+    __u64 offset;           // In the device buffer
+    __u64 length;
+    __u64 data;             // Offset of the payload in the data area
+    __u64 user_data;        // Echoed in the CQE
+};
+
+struct ram_cqe {
+    __u64 user_data;
+    __s64 result;           // As for RAM_BATCH
+};
+
+struct ram_ring_setup {
+    __u32 entries;          // SQ and CQ size, a power of two
+    __u32 flags;            // RAM_RING_SQPOLL
+    __u32 data_size;        // Bytes in the data area
+    __u32 sq_idle_ms;       // SQPOLL: poll this long without work before sleeping
+    __u32 sq_off;           // Out: offsets in the mapping
+    __u32 cq_off;
+    __u32 data_off;
+    __u32 ring_size;        // Out: bytes to mmap at RAM_RING_OFF
+};
+
+#define RAM_RING_SQPOLL 0x1
+#define RAM_RING_NEED_WAKEUP 0x1
+
+#define RAM_RING_OFF (1ULL << 40)       // mmap offset of the rings, above any buffer offset
+#define RAM_RING_MAX_ENTRIES 4096
+#define RAM_RING_MAX_DATA (16 << 20)
+#define RAM_RING_DEFAULT_IDLE_MS 100
+
+struct ram_ring {
+    void *mem;              // vmalloc_user() area shared with user space
+    size_t size;
+    struct ram_ring_hdr *hdr;
+    struct ram_sqe *sqes;
+    struct ram_cqe *cqes;
+    char *data;
+    u32 entries;
+    u32 data_size;
+    u32 sq_head;            // Private copies; user space may scribble on the shared ones
+    u32 cq_tail;
+    struct mutex lock;      // Serializes doorbell processing
+    struct task_struct *thread;     // SQPOLL kthread, or NULL
+    unsigned long idle;             // SQPOLL idle timeout in jiffies
+};
+
+/*
+ * Runs one SQE. Long ops go RAM_BATCH_WINDOW bytes at a time, each window
+ * under its own stripe locks with a reschedule in between. A CLEAR, COUNT or
+ * CRC over gigabytes thus never spins other CPUs or starves the SQPOLL
+ * thread's CPU.
+ */
+static s64 ram_ring_run_op(struct ram_ring *ring, const struct ram_sqe *sqe) {
+    char *p, *data = NULL;
+    u64 pos, done, n;
+    u64 vowels = 0;
+    u32 crc = ~0U;
+    long old;
+
+    if (sqe->offset > buffer_size || sqe->length > buffer_size - sqe->offset)
+        return -EINVAL;
+    switch (sqe->opcode) {
+        case RAM_OP_READ:
+        case RAM_OP_WRITE:
+            if (sqe->data > ring->data_size || sqe->length > ring->data_size - sqe->data)
+                return -EINVAL;
+            data = ring->data + sqe->data;
+            break;
+        case RAM_OP_CLEAR:
+        case RAM_OP_COUNT_VOWELS:
+        case RAM_OP_CRC32C:
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    for (done = 0; done < sqe->length; done += n) {
+        pos = sqe->offset + done;
+        n = min_t(u64, sqe->length - done, RAM_BATCH_WINDOW);
+        p = ram_array + pos;
+
+        switch (sqe->opcode) {
+            case RAM_OP_READ:
+                ram_range_read_lock(pos, n);
+                memcpy(data + done, p, n);
+                ram_range_read_unlock(pos, n);
+                break;
+
+            case RAM_OP_WRITE:
+                ram_range_write_lock(pos, n);
+                old = ram_count_vowels(p, n);
+                memcpy(p, data + done, n);
+                atomic_long_add((long)ram_count_vowels(p, n) - old, &ram_vowels);
+                ram_update_page_csums(pos, n);
+                ram_range_write_unlock(pos, n);
+                break;
+
+            case RAM_OP_CLEAR:
+                ram_range_write_lock(pos, n);
+                atomic_long_sub(ram_count_vowels(p, n), &ram_vowels);
+                memset(p, 0, n);
+                ram_update_page_csums(pos, n);
+                ram_range_write_unlock(pos, n);
+                break;
+
+            case RAM_OP_COUNT_VOWELS:
+                ram_range_read_lock(pos, n);
+                vowels += ram_count_vowels(p, n);
+                ram_range_read_unlock(pos, n);
+                break;
+
+            case RAM_OP_CRC32C:
+                ram_range_read_lock(pos, n);
+                crc = crc32c(crc, p, n);
+                ram_range_read_unlock(pos, n);
+                break;
+        }
+        cond_resched();
+    }
+
+    switch (sqe->opcode) {
+        case RAM_OP_READ:
+            ram_stat_add(bytes_read, sqe->length);
+            break;
+        case RAM_OP_WRITE:
+            ram_stat_add(bytes_written, sqe->length);
+            break;
+        case RAM_OP_COUNT_VOWELS:
+            return vowels;
+        case RAM_OP_CRC32C:
+            return ~crc;
+    }
+    return sqe->length;
+}
+
+static bool ram_ring_pending(struct ram_ring *ring) {
+    return ring->sq_head != smp_load_acquire(&ring->hdr->sq_tail);
+}
+
+// Consume SQEs until the SQ is empty or the CQ is full; returns how many were consumed
+static unsigned int ram_ring_process(struct ram_ring *ring) {
+    struct ram_ring_hdr *hdr = ring->hdr;
+    u32 mask = ring->entries - 1;
+    u32 sq_tail = smp_load_acquire(&hdr->sq_tail);
+    u32 cq_head = smp_load_acquire(&hdr->cq_head);
+    unsigned int done = 0;
+
+    while (ring->sq_head != sq_tail && ring->cq_tail - cq_head < ring->entries) {
+        struct ram_sqe *shared = &ring->sqes[ring->sq_head & mask];
+        struct ram_cqe *cqe = &ring->cqes[ring->cq_tail & mask];
+        struct ram_sqe sqe;
+
+        // Snapshot the SQE so user space cannot change it while it is checked and run
+        sqe.opcode = READ_ONCE(shared->opcode);
+        sqe.offset = READ_ONCE(shared->offset);
+        sqe.length = READ_ONCE(shared->length);
+        sqe.data = READ_ONCE(shared->data);
+        sqe.user_data = READ_ONCE(shared->user_data);
+
+        cqe->user_data = sqe.user_data;
+        cqe->result = ram_ring_run_op(ring, &sqe);
+        ring->sq_head++;
+        ring->cq_tail++;
+        done++;
+    }
+
+    if (done) {
+        smp_store_release(&hdr->sq_head, ring->sq_head);
+        smp_store_release(&hdr->cq_tail, ring->cq_tail);
+    }
+    return done;
+}
+
+static int ram_ring_thread(void *arg) {
+    struct ram_ring *ring = arg;
+    unsigned long idle_end = jiffies + ring->idle;
+
+    while (!kthread_should_stop()) {
+        if (ram_ring_process(ring)) {
+            idle_end = jiffies + ring->idle;
+        } else if (time_before(jiffies, idle_end)) {
+            cpu_relax();
+        } else {
+            // Publish NEED_WAKEUP before the final check, so a submission cannot slip past
+            set_current_state(TASK_INTERRUPTIBLE);
+            WRITE_ONCE(ring->hdr->flags, RAM_RING_NEED_WAKEUP);
+            smp_mb();
+            if (!ram_ring_pending(ring) && !kthread_should_stop())
+                schedule();
+            __set_current_state(TASK_RUNNING);
+            WRITE_ONCE(ring->hdr->flags, 0);
+            idle_end = jiffies + ring->idle;
+        }
+        cond_resched();
+    }
+    return 0;
+}
+
+static void ram_ring_free(struct ram_ring *ring) {
+    if (ring->thread)
+        kthread_stop(ring->thread);
+    vfree(ring->mem);
+    kfree(ring);
+}
+
+static long ram_ring_setup_ioctl(struct file *file, struct ram_ring_setup __user *usetup) {
+    struct ram_ring_setup setup;
+    struct ram_ring *ring;
+    long ret;
+
+    if (copy_from_user(&setup, usetup, sizeof(setup)))
+        return -EFAULT;
+    if (!setup.entries || setup.entries > RAM_RING_MAX_ENTRIES || !is_power_of_2(setup.entries) ||
+        setup.data_size > RAM_RING_MAX_DATA || setup.flags & ~RAM_RING_SQPOLL)
+        return -EINVAL;
+    // A polling kthread burns a CPU on the caller's behalf
+    if ((setup.flags & RAM_RING_SQPOLL) && !capable(CAP_SYS_NICE))
+        return -EPERM;
+
+    setup.sq_off = ALIGN(sizeof(struct ram_ring_hdr), SMP_CACHE_BYTES);
+    setup.cq_off = ALIGN(setup.sq_off + setup.entries * sizeof(struct ram_sqe), SMP_CACHE_BYTES);
+    setup.data_off = PAGE_ALIGN(setup.cq_off + setup.entries * sizeof(struct ram_cqe));
+    setup.ring_size = setup.data_off + PAGE_ALIGN(setup.data_size);
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return -ENOMEM;
+    ring->mem = vmalloc_user(setup.ring_size);
+    if (!ring->mem) {
+        kfree(ring);
+        return -ENOMEM;
+    }
+    ring->size = setup.ring_size;
+    ring->hdr = ring->mem;
+    ring->sqes = ring->mem + setup.sq_off;
+    ring->cqes = ring->mem + setup.cq_off;
+    ring->data = ring->mem + setup.data_off;
+    ring->entries = setup.entries;
+    ring->data_size = setup.data_size;
+    ring->hdr->entries = setup.entries;
+    mutex_init(&ring->lock);
+
+    // Start the poller before publishing the ring, so the doorbell never sees it half set up
+    if (setup.flags & RAM_RING_SQPOLL) {
+        ring->idle = msecs_to_jiffies(setup.sq_idle_ms ?: RAM_RING_DEFAULT_IDLE_MS);
+        ring->thread = kthread_run(ram_ring_thread, ring, "%s_sq", DEVICE_NAME);
+        if (IS_ERR(ring->thread)) {
+            ret = PTR_ERR(ring->thread);
+            ring->thread = NULL;
+            ram_ring_free(ring);
+            return ret;
+        }
+    }
+
+    // One ring pair per open file
+    if (cmpxchg(&file->private_data, NULL, ring)) {
+        ram_ring_free(ring);
+        return -EBUSY;
+    }
+
+    if (copy_to_user(usetup, &setup, sizeof(setup)))
+        return -EFAULT;
+    return 0;
+}
+
+// The doorbell: process pending SQEs, or wake the SQPOLL kthread if it sleeps
+static long ram_ring_enter_ioctl(struct file *file) {
+    struct ram_ring *ring = READ_ONCE(file->private_data);
+    long done;
+
+    if (!ring)
+        return -EINVAL;
+    if (ring->thread) {
+        if (READ_ONCE(ring->hdr->flags) & RAM_RING_NEED_WAKEUP)
+            wake_up_process(ring->thread);
+        return 0;
+    }
+
+    mutex_lock(&ring->lock);
+    done = ram_ring_process(ring);
+    mutex_unlock(&ring->lock);
+    return done;
+}
+
+static int ram_ring_mmap(struct file *file, struct vm_area_struct *vma) {
+    struct ram_ring *ring = READ_ONCE(file->private_data);
+
+    if (!ring || vma_pages(vma) > ring->size >> PAGE_SHIFT)
+        return -EINVAL;
+    return remap_vmalloc_range(vma, ring->mem, 0);
+}
+
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int count = 0;
+    int size = min_t(unsigned long, buffer_size, INT_MAX);
+    u64 size64 = buffer_size;
 
     switch (cmd) {
         case RAM_GET_SIZE:
-            read_lock(&ram_rwlock);
-            if (copy_to_user((int __user *)arg, &buffer_size, sizeof(int))) {
-                read_unlock(&ram_rwlock);
+            // The size is fixed at load time, so no lock is needed
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
                 return -EFAULT;
-            }
-            read_unlock(&ram_rwlock);
-            printk(KERN_INFO "ram_array: Size = %d\n", buffer_size);
+            trace_ram_ioctl(cmd, size);
+            pr_debug("ram_array: Size = %d\n", size);
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
+                return -EFAULT;
+            trace_ram_ioctl(cmd, size64);
             break;
 
         case RAM_CLEAR:
-            write_lock(&ram_rwlock);
-            memset(ram_array, 0, BUFFER_SIZE);
-            write_unlock(&ram_rwlock);
-            printk(KERN_INFO "ram_array: Buffer cleared\n");
+            ram_clear_range(0, buffer_size);
+            trace_ram_ioctl(cmd, 0);
+            pr_debug("ram_array: Buffer cleared\n");
             break;
 
         case RAM_COUNT_VOWELS:
-            read_lock(&ram_rwlock);
-            for (i = 0; i < BUFFER_SIZE; i++) {
-                char c = ram_array[i];
-                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
-                    c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U') {
-                    count++;
-                }
-            }
-            read_unlock(&ram_rwlock);
+            count = min_t(long, atomic_long_read(&ram_vowels), INT_MAX);
             if (copy_to_user((int __user *)arg, &count, sizeof(int)))
                 return -EFAULT;
-            printk(KERN_INFO "ram_array: Counted %d vowels\n", count);
+            trace_ram_ioctl(cmd, count);
+            pr_debug("ram_array: Counted %d vowels\n", count);
             break;
 
+        case RAM_BYTE_HIST:
+            return ram_byte_hist_ioctl((struct ram_hist_req __user *)arg);
+
+        case RAM_SEARCH:
+            return ram_search_ioctl((struct ram_search_req __user *)arg);
+
+        case RAM_CHECKSUM:
+            return ram_csum_ioctl((struct ram_csum_req __user *)arg);
+
+        case RAM_PAGE_CSUMS:
+            return ram_page_csums_ioctl((struct ram_page_csums_req __user *)arg);
+
+        case RAM_BATCH:
+            return ram_batch_ioctl((struct ram_batch __user *)arg);
+
+        case RAM_RING_SETUP:
+            return ram_ring_setup_ioctl(file, (struct ram_ring_setup __user *)arg);
+
+        case RAM_RING_ENTER:
+            return ram_ring_enter_ioctl(file);
+
         default:
             return -EINVAL;
     }
@@ -142,29 +1538,99 @@ static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    long ret = ram_do_ioctl(file, cmd, arg);
+
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
+/*
+ * io_uring passthrough: IORING_OP_URING_CMD with cmd_op set to any RAM_* ioctl
+ * number runs that command, so it can share an event loop with other I/O. The
+ * SQE command area holds struct ram_uring_cmd, whose arg is what ioctl() would
+ * have been passed. Commands that scan or modify the buffer, or that may sleep,
+ * return -EAGAIN on the nonblocking issue, and io_uring retries them from an
+ * io-wq worker instead of stalling the submitter.
+ */
+struct ram_uring_cmd {
+    __u64 arg;
+    __u64 reserved;
+};
+
+static bool ram_uring_cmd_inline(unsigned int cmd) {
+    switch (cmd) {
+        case RAM_GET_SIZE:
+        case RAM_GET_SIZE64:
+        case RAM_COUNT_VOWELS:     // Kept up to date by writers, so just a copy out
+            return true;
+    }
+    return false;
+}
+
+static int ram_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+    const struct ram_uring_cmd *ucmd = io_uring_sqe_cmd(ioucmd->sqe);
+    unsigned int cmd = ioucmd->cmd_op;
+
+    if ((issue_flags & IO_URING_F_NONBLOCK) && !ram_uring_cmd_inline(cmd))
+        return -EAGAIN;
+    return ram_ioctl(ioucmd->file, cmd, READ_ONCE(ucmd->arg));
+}
+
 static int __init ram_init(void) {
-    major = register_chrdev(0, DEVICE_NAME, &ram_fops);
-    if (major < 0) {
-        printk(KERN_ALERT "ram_array: Failed to register char device\n");
-        return major;
+    if (!buffer_size)
+        return -EINVAL;
+
+    // Everything an open file can reach is set up before the device appears
+    ram_stripes_init();
+
+    ram_array = vzalloc(buffer_size);
+    if (!ram_array)
+        return -ENOMEM;
+
+    if (page_csums) {
+        ram_page_crc = vmalloc_array(DIV_ROUND_UP(buffer_size, PAGE_SIZE), sizeof(u32));
+        if (!ram_page_crc) {
+            vfree(ram_array);
+            return -ENOMEM;
+        }
+        ram_update_page_csums(0, buffer_size);
     }
 
-    ram_array = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-    if (!ram_array) {
-        unregister_chrdev(major, DEVICE_NAME);
+    ram_scan_wq = alloc_workqueue("%s_scan", WQ_UNBOUND, 0, DEVICE_NAME);
+    if (!ram_scan_wq) {
+        vfree(ram_page_crc);
+        vfree(ram_array);
         return -ENOMEM;
     }
 
-    memset(ram_array, 0, BUFFER_SIZE);
-    rwlock_init(&ram_rwlock);
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+    debugfs_create_file("latency", 0644, ram_debugfs_dir, NULL, &ram_latency_fops);
+    debugfs_create_file("scan_bench", 0444, ram_debugfs_dir, NULL, &ram_scan_bench_fops);
+
+    major = register_chrdev(0, DEVICE_NAME, &ram_fops);
+    if (major < 0) {
+        printk(KERN_ALERT "ram_array: Failed to register char device\n");
+        debugfs_remove_recursive(ram_debugfs_dir);
+        destroy_workqueue(ram_scan_wq);
+        vfree(ram_page_crc);
+        vfree(ram_array);
+        return major;
+    }
 
     printk(KERN_INFO "ram_array (rwlock) driver registered with major %d\n", major);
     return 0;
 }
 
 static void __exit ram_exit(void) {
-    kfree(ram_array);
     unregister_chrdev(major, DEVICE_NAME);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    destroy_workqueue(ram_scan_wq);
+    vfree(ram_page_crc);
+    vfree(ram_array);
     printk(KERN_INFO "ram_array: Driver unregistered\n");
 }
 
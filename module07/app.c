@@ -5,12 +5,47 @@
 #include <sys/ioctl.h>
 #include <string.h>
 #include <errno.h>
+#include <linux/types.h>
 
 #define DEVICE_PATH "/dev/ram_array7"
 #define RAM_CLEAR_BUFFER _IO('R', 2)
 #define RAM_GET_SIZE _IOR('R', 1, int)
 #define RAM_COUNT_VOWELS _IOR('R', 3, int)
 
+struct ram_hist_req {
+    __u64 offset;
+    __u64 length;
+    __u8 class_map[32];
+    __u64 class_count;
+    __u64 hist[256];
+};
+#define RAM_BYTE_HIST _IOWR('R', 6, struct ram_hist_req)
+
+struct ram_search_req {
+    __u64 offset;
+    __u64 length;
+    __u64 pattern;
+    __u64 matches;
+    __u32 pattern_len;
+    __u32 max_matches;
+    __u32 nr_matches;
+    __u32 flags;
+};
+#define RAM_SEARCH_ICASE 0x1
+#define RAM_SEARCH _IOWR('R', 7, struct ram_search_req)
+
+struct ram_csum_req {
+    __u64 offset;
+    __u64 length;
+    __u32 algo;
+    __u32 reserved;
+    __u64 csum;
+};
+#define RAM_CSUM_CRC32C 0
+#define RAM_CSUM_XXH64 1
+#define RAM_CHECKSUM _IOWR('R', 8, struct ram_csum_req)
+#define RAM_RESIZE _IOW('R', 13, __u64)
+
 void clear_buffer(int fd) {
     ioctl(fd, RAM_CLEAR_BUFFER);
     printf("Buffer cleared.\n");
@@ -33,6 +68,102 @@ void count_vowels(int fd) {
     printf("Vowel count in buffer: %d\n", vowel_count);
 }
 
+// Histogram of a range, with the vowels as the character class
+void byte_histogram(int fd) {
+    struct ram_hist_req req;
+    const char *vowels = "aeiouAEIOU";
+    unsigned long long offset, length;
+    int i;
+
+    memset(&req, 0, sizeof(req));
+    printf("Enter offset and length (0 = to end): ");
+    scanf("%llu %llu", &offset, &length);
+    getchar();
+    req.offset = offset;
+    req.length = length;
+    for (i = 0; vowels[i]; i++)
+        req.class_map[(unsigned char)vowels[i] / 8] |= 1 << ((unsigned char)vowels[i] % 8);
+
+    if (ioctl(fd, RAM_BYTE_HIST, &req) < 0) {
+        perror("RAM_BYTE_HIST failed");
+        return;
+    }
+    for (i = 0; i < 256; i++) {
+        if (!req.hist[i])
+            continue;
+        if (i >= 32 && i < 127)
+            printf("'%c': %llu\n", i, (unsigned long long)req.hist[i]);
+        else
+            printf("0x%02x: %llu\n", i, (unsigned long long)req.hist[i]);
+    }
+    printf("Vowels in range: %llu\n", (unsigned long long)req.class_count);
+}
+
+// Search the whole buffer for a pattern, ignoring case
+void search_pattern(int fd) {
+    struct ram_search_req req;
+    __u64 matches[16];
+    char pattern[100];
+    unsigned int i;
+
+    printf("Enter pattern: ");
+    fgets(pattern, sizeof(pattern), stdin);
+    pattern[strcspn(pattern, "\n")] = '\0';
+    if (!pattern[0])
+        return;
+
+    memset(&req, 0, sizeof(req));
+    req.pattern = (__u64)(unsigned long)pattern;
+    req.pattern_len = strlen(pattern);
+    req.matches = (__u64)(unsigned long)matches;
+    req.max_matches = 16;
+    req.flags = RAM_SEARCH_ICASE;
+
+    if (ioctl(fd, RAM_SEARCH, &req) < 0) {
+        perror("RAM_SEARCH failed");
+        return;
+    }
+    printf("%u match(es)%s\n", req.nr_matches, req.nr_matches == 16 ? " (first 16)" : "");
+    for (i = 0; i < req.nr_matches; i++)
+        printf("  offset %llu\n", (unsigned long long)matches[i]);
+}
+
+// CRC-32C and xxHash64 of the whole buffer, computed in the kernel
+void checksum(int fd) {
+    struct ram_csum_req req;
+
+    memset(&req, 0, sizeof(req));
+    req.algo = RAM_CSUM_CRC32C;
+    if (ioctl(fd, RAM_CHECKSUM, &req) < 0) {
+        perror("RAM_CHECKSUM failed");
+        return;
+    }
+    printf("crc32c: %08llx\n", (unsigned long long)req.csum);
+
+    req.algo = RAM_CSUM_XXH64;
+    if (ioctl(fd, RAM_CHECKSUM, &req) < 0) {
+        perror("RAM_CHECKSUM failed");
+        return;
+    }
+    printf("xxh64:  %016llx\n", (unsigned long long)req.csum);
+}
+
+// Resize the buffer; readers keep running on the old version meanwhile
+void resize_buffer(int fd) {
+    unsigned long long size;
+    __u64 new_size;
+
+    printf("Enter new size in bytes: ");
+    scanf("%llu", &size);
+    getchar();
+    new_size = size;
+    if (ioctl(fd, RAM_RESIZE, &new_size) < 0) {
+        perror("RAM_RESIZE failed");
+        return;
+    }
+    printf("Buffer resized to %llu bytes.\n", size);
+}
+
 void write_data(int fd) {
     char buffer[100];
     printf("Enter data to write: ");
@@ -69,17 +200,10 @@ int main() {
     //}
     //
     //
-    int fd;
-
-    // Retry loop for open()
-    while ((fd = open(DEVICE_PATH, O_RDWR)) == -1) {
-        if (errno == EBUSY) {
-            printf("Device busy, retrying...\n");
-            usleep(100000); // Sleep for 100ms before retry
-        } else {
-            perror("Failed to open device");
-            return 1;
-        }
+    int fd = open(DEVICE_PATH, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open device");
+        return 1;
     }
 
     printf("Device opened successfully with fd = %d\n", fd);
@@ -95,6 +219,10 @@ int main() {
         //printf("6. Set Cursor (ioctl)\n");
         printf("7. Count Vowels (ioctl)\n");
         printf("8. Exit\n");
+        printf("9. Byte Histogram (ioctl)\n");
+        printf("10. Search (ioctl)\n");
+        printf("11. Checksum (ioctl)\n");
+        printf("12. Resize Buffer (ioctl)\n");
         printf("Choice: ");
         scanf("%d", &choice);
         getchar();
@@ -128,6 +256,18 @@ int main() {
             case 8:
                 close(fd);
                 return 0;
+            case 9:
+                byte_histogram(fd);
+                break;
+            case 10:
+                search_pattern(fd);
+                break;
+            case 11:
+                checksum(fd);
+                break;
+            case 12:
+                resize_buffer(fd);
+                break;
             default:
                 printf("Invalid choice.\n");
         }
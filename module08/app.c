@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEVICE_PATH "/dev/ram_array8"
+#define RAM_CLEAR_BUFFER _IO('R', 2)
+#define RAM_GET_SIZE _IOR('R', 1, int)
+#define RAM_FIFO_LEN _IOR('R', 5, int)
+
+// Producer: every line typed on stdin is pushed into the FIFO
+void run_producer(int fd) {
+    char buffer[256];
+
+    printf("Producer ready, type lines (Ctrl-D to stop):\n");
+    while (fgets(buffer, sizeof(buffer), stdin)) {
+        size_t len = strlen(buffer), done = 0;
+
+        while (done < len) {
+            ssize_t n = write(fd, buffer + done, len - done);  // Blocks while the FIFO is full
+            if (n < 0) {
+                perror("write");
+                return;
+            }
+            done += n;
+        }
+    }
+}
+
+// Consumer: blocking reads return as soon as the producer has written
+void run_consumer(int fd) {
+    char buffer[256];
+    ssize_t n;
+
+    printf("Consumer waiting for data...\n");
+    while ((n = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
+        buffer[n] = '\0';
+        printf("Received: %s", buffer);
+        fflush(stdout);
+    }
+    if (n < 0)
+        perror("read");
+}
+
+// Poller: non-blocking reads driven by poll()
+void run_poller(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char buffer[256];
+    ssize_t n;
+
+    printf("Polling for data...\n");
+    while (poll(&pfd, 1, -1) > 0) {
+        if (!(pfd.revents & POLLIN))
+            continue;
+        n = read(fd, buffer, sizeof(buffer) - 1);
+        if (n < 0 && errno == EAGAIN)
+            continue;
+        if (n <= 0)
+            break;
+        buffer[n] = '\0';
+        printf("Polled: %s", buffer);
+        fflush(stdout);
+    }
+}
+
+void show_status(int fd) {
+    int size, len;
+
+    ioctl(fd, RAM_GET_SIZE, &size);
+    ioctl(fd, RAM_FIFO_LEN, &len);
+    printf("FIFO holds %d of %d bytes\n", len, size);
+}
+
+int main(int argc, char *argv[]) {
+    int fd;
+
+    if (argc != 2) {
+        printf("Usage: %s p|c|l|s|x\n", argv[0]);
+        printf("  p = producer, c = consumer, l = poll consumer, s = status, x = clear\n");
+        return 1;
+    }
+
+    fd = open(DEVICE_PATH, argv[1][0] == 'l' ? O_RDWR | O_NONBLOCK : O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    switch (argv[1][0]) {
+        case 'p':
+            run_producer(fd);
+            break;
+        case 'c':
+            run_consumer(fd);
+            break;
+        case 'l':
+            run_poller(fd);
+            break;
+        case 's':
+            show_status(fd);
+            break;
+        case 'x':
+            ioctl(fd, RAM_CLEAR_BUFFER);
+            printf("FIFO cleared.\n");
+            break;
+        default:
+            printf("Invalid mode.\n");
+    }
+
+    close(fd);
+    return 0;
+}
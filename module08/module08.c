@@ -0,0 +1,351 @@
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/ioctl.h>
+#include <linux/kfifo.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
+#define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64)
+#define RAM_FIFO_LEN _IOR(RAM_IOC_MAGIC, 5, int)
+
+#define DEVICE_NAME "ram_array8"
+#define DEFAULT_FIFO_SIZE 4096
+
+static unsigned long fifo_size = DEFAULT_FIFO_SIZE;
+module_param(fifo_size, ulong, 0444);
+MODULE_PARM_DESC(fifo_size, "Capacity of the FIFO in bytes, rounded up to a power of two (default 4096)");
+
+static int major;
+static char *fifo_buffer;
+static DECLARE_KFIFO_PTR(ram_fifo, char);
+
+/*
+ * kfifo is lock-free for exactly one reader and one writer: the reader only
+ * moves 'out' and the writer only moves 'in'. These mutexes serialize readers
+ * among themselves and writers among themselves, so a producer and a consumer
+ * never wait on each other.
+ */
+static DEFINE_MUTEX(ram_read_mutex);
+static DEFINE_MUTEX(ram_write_mutex);
+
+static DECLARE_WAIT_QUEUE_HEAD(ram_read_wq);   // Readers waiting for data
+static DECLARE_WAIT_QUEUE_HEAD(ram_write_wq);  // Writers waiting for space
+
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 opens;
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array8/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.opens += s->opens;
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+    }
+
+    seq_printf(m, "opens:         %llu\n", sum.opens);
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+// Function prototypes
+static int ram_open(struct inode *inode, struct file *file);
+static int ram_release(struct inode *inode, struct file *file);
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static __poll_t ram_poll(struct file *file, poll_table *wait);
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+
+static struct file_operations ram_fops = {
+    .owner = THIS_MODULE,
+    .open = ram_open,
+    .release = ram_release,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
+    .poll = ram_poll,
+    .unlocked_ioctl = ram_ioctl,
+};
+
+static int ram_open(struct inode *inode, struct file *file) {
+    printk(KERN_INFO "ram_array: Device opened\n");
+    ram_stat_inc(opens);
+    // A FIFO has no positions to seek to
+    return nonseekable_open(inode, file);
+}
+
+static int ram_release(struct inode *inode, struct file *file) {
+    printk(KERN_INFO "ram_array: Device released\n");
+    return 0;
+}
+
+// O_NONBLOCK, or io_uring's first non-blocking attempt before it falls back to poll
+static bool ram_nowait(struct kiocb *iocb) {
+    return (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+}
+
+/*
+ * kfifo_to_user()/kfifo_from_user() copy straight between the FIFO and one
+ * user buffer, so walk the user segments of the iterator one at a time. Stops
+ * at the first segment the FIFO cannot fill (or drain) completely. Returns
+ * the bytes moved, or an error if nothing was.
+ */
+static ssize_t ram_fifo_to_iter(struct iov_iter *to) {
+    size_t total = 0, len;
+    unsigned int copied;
+    int ret;
+
+    while (iov_iter_count(to)) {
+        len = min_t(size_t, iter_iov_len(to), UINT_MAX);
+        ret = kfifo_to_user(&ram_fifo, iter_iov_addr(to), len, &copied);
+        if (ret)
+            return total ? total : ret;
+        // Advancing by 0 still steps over an empty segment
+        iov_iter_advance(to, copied);
+        total += copied;
+        if (copied < len)
+            break;
+    }
+    return total;
+}
+
+static ssize_t ram_fifo_from_iter(struct iov_iter *from) {
+    size_t total = 0, len;
+    unsigned int copied;
+    int ret;
+
+    while (iov_iter_count(from)) {
+        len = min_t(size_t, iter_iov_len(from), UINT_MAX);
+        ret = kfifo_from_user(&ram_fifo, iter_iov_addr(from), len, &copied);
+        if (ret)
+            return total ? total : ret;
+        iov_iter_advance(from, copied);
+        total += copied;
+        if (copied < len)
+            break;
+    }
+    return total;
+}
+
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    ssize_t ret;
+
+    if (!iov_iter_count(to))
+        return 0;
+    // readv() and io_uring hand in user memory; kernel buffers have no use for a FIFO device
+    if (!user_backed_iter(to))
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&ram_read_mutex))
+        return -ERESTARTSYS;
+
+    // Sleep until the producer has queued something
+    while (kfifo_is_empty(&ram_fifo)) {
+        mutex_unlock(&ram_read_mutex);
+        if (ram_nowait(iocb))
+            return -EAGAIN;
+        if (wait_event_interruptible(ram_read_wq, !kfifo_is_empty(&ram_fifo)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&ram_read_mutex))
+            return -ERESTARTSYS;
+    }
+
+    ret = ram_fifo_to_iter(to);
+    mutex_unlock(&ram_read_mutex);
+    if (ret < 0) {
+        ram_stat_inc(efaults);
+        return ret;
+    }
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, ret);
+
+    // wq_has_sleeper() keeps the wait queue lock off the path when nobody waits
+    if (wq_has_sleeper(&ram_write_wq))
+        wake_up_interruptible(&ram_write_wq);
+    return ret;
+}
+
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    ssize_t ret;
+
+    if (!iov_iter_count(from))
+        return 0;
+    if (!user_backed_iter(from))
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&ram_write_mutex))
+        return -ERESTARTSYS;
+
+    // Sleep until the consumer has made room
+    while (kfifo_is_full(&ram_fifo)) {
+        mutex_unlock(&ram_write_mutex);
+        if (ram_nowait(iocb))
+            return -EAGAIN;
+        if (wait_event_interruptible(ram_write_wq, !kfifo_is_full(&ram_fifo)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&ram_write_mutex))
+            return -ERESTARTSYS;
+    }
+
+    // Partial writes are allowed, as with a pipe
+    ret = ram_fifo_from_iter(from);
+    mutex_unlock(&ram_write_mutex);
+    if (ret < 0) {
+        ram_stat_inc(efaults);
+        return ret;
+    }
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, ret);
+
+    if (wq_has_sleeper(&ram_read_wq))
+        wake_up_interruptible(&ram_read_wq);
+    return ret;
+}
+
+static __poll_t ram_poll(struct file *file, poll_table *wait) {
+    __poll_t mask = 0;
+
+    poll_wait(file, &ram_read_wq, wait);
+    poll_wait(file, &ram_write_wq, wait);
+
+    if (!kfifo_is_empty(&ram_fifo))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (!kfifo_is_full(&ram_fifo))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
+}
+
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int size = min_t(unsigned int, kfifo_size(&ram_fifo), INT_MAX);
+    u64 size64 = kfifo_size(&ram_fifo);
+    int len;
+
+    switch (cmd) {
+        case RAM_GET_SIZE:
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
+                return -EFAULT;
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
+                return -EFAULT;
+            break;
+
+        case RAM_CLEAR:
+            // Resetting moves both indices, so stop readers and writers first
+            mutex_lock(&ram_read_mutex);
+            mutex_lock(&ram_write_mutex);
+            kfifo_reset(&ram_fifo);
+            mutex_unlock(&ram_write_mutex);
+            mutex_unlock(&ram_read_mutex);
+            wake_up_interruptible(&ram_write_wq);
+            printk(KERN_INFO "ram_array: FIFO cleared\n");
+            break;
+
+        case RAM_FIFO_LEN:
+            len = kfifo_len(&ram_fifo);
+            if (copy_to_user((int __user *)arg, &len, sizeof(int)))
+                return -EFAULT;
+            break;
+
+        default:
+            return -EINVAL;
+    }
+    return 0;
+}
+
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    long ret = ram_do_ioctl(file, cmd, arg);
+
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
+static int __init ram_init(void) {
+    unsigned long size;
+    int ret;
+
+    if (!fifo_size || fifo_size > (1UL << 31))
+        return -EINVAL;
+    size = roundup_pow_of_two(fifo_size);
+
+    // The FIFO must exist before the device appears, or an early open would use it uninitialised
+    fifo_buffer = vmalloc(size);
+    if (!fifo_buffer)
+        return -ENOMEM;
+
+    ret = kfifo_init(&ram_fifo, fifo_buffer, size);
+    if (ret) {
+        vfree(fifo_buffer);
+        return ret;
+    }
+
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+
+    major = register_chrdev(0, DEVICE_NAME, &ram_fops);
+    if (major < 0) {
+        printk(KERN_ALERT "ram_array: Failed to register char device\n");
+        debugfs_remove_recursive(ram_debugfs_dir);
+        vfree(fifo_buffer);
+        return major;
+    }
+
+    printk(KERN_INFO "ram_array (fifo) driver registered with major %d, %lu bytes\n", major, size);
+    return 0;
+}
+
+static void __exit ram_exit(void) {
+    unregister_chrdev(major, DEVICE_NAME);
+    debugfs_remove_recursive(ram_debugfs_dir);
+    vfree(fifo_buffer);
+    printk(KERN_INFO "ram_array: Driver unregistered\n");
+}
+
+module_init(ram_init);
+module_exit(ram_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Koushik");
+MODULE_DESCRIPTION("RAM-backed FIFO device driver using a lock-free kfifo with blocking I/O and poll");
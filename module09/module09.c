@@ -0,0 +1,377 @@
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/ioctl.h>
+#include <linux/seqlock.h>
+
+#define RAM_IOC_MAGIC 'R'
+#define RAM_GET_SIZE _IOR(RAM_IOC_MAGIC, 1, int)
+#define RAM_CLEAR _IO(RAM_IOC_MAGIC, 2)
+#define RAM_COUNT_VOWELS _IOR(RAM_IOC_MAGIC, 3, int)
+#define RAM_GET_SIZE64 _IOR(RAM_IOC_MAGIC, 4, __u64)
+
+#define DEVICE_NAME "ram_array9"
+#define DEFAULT_BUFFER_SIZE 1024
+#define RAM_BOUNCE_SIZE (16 * 1024)  // Largest piece copied per sequence section
+
+static unsigned long buffer_size = DEFAULT_BUFFER_SIZE;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Size of the RAM buffer in bytes (default 1024)");
+
+static int major;
+static char *ram_array;
+
+/*
+ * Writers take the seqlock's spinlock and bump its sequence count around every
+ * change. Readers never store to it: they note the count, copy the data into a
+ * private bounce buffer, and retry if a writer got in meanwhile. A reader
+ * therefore leaves no shared cacheline dirty, unlike read_lock() in module06.
+ */
+static DEFINE_SEQLOCK(ram_seqlock);
+static long ram_vowels;  // Running vowel count, written under ram_seqlock
+
+// Per-CPU operation counters: the hot path only touches its own CPU's copy
+struct ram_stats {
+    u64 opens;
+    u64 reads;
+    u64 writes;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 ioctls;
+    u64 efaults;
+    u64 read_retries;    // Optimistic copies thrown away because a writer raced
+};
+
+static DEFINE_PER_CPU(struct ram_stats, ram_stats);
+static struct dentry *ram_debugfs_dir;
+
+#define ram_stat_inc(field) this_cpu_inc(ram_stats.field)
+#define ram_stat_add(field, n) this_cpu_add(ram_stats.field, n)
+
+// debugfs: <debugfs>/ram_array9/stats, summed over all CPUs on read
+static int ram_stats_show(struct seq_file *m, void *v) {
+    struct ram_stats sum = {};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ram_stats *s = per_cpu_ptr(&ram_stats, cpu);
+
+        sum.opens += s->opens;
+        sum.reads += s->reads;
+        sum.writes += s->writes;
+        sum.bytes_read += s->bytes_read;
+        sum.bytes_written += s->bytes_written;
+        sum.ioctls += s->ioctls;
+        sum.efaults += s->efaults;
+        sum.read_retries += s->read_retries;
+    }
+
+    seq_printf(m, "opens:         %llu\n", sum.opens);
+    seq_printf(m, "reads:         %llu\n", sum.reads);
+    seq_printf(m, "writes:        %llu\n", sum.writes);
+    seq_printf(m, "bytes_read:    %llu\n", sum.bytes_read);
+    seq_printf(m, "bytes_written: %llu\n", sum.bytes_written);
+    seq_printf(m, "ioctls:        %llu\n", sum.ioctls);
+    seq_printf(m, "efaults:       %llu\n", sum.efaults);
+    seq_printf(m, "read_retries:  %llu\n", sum.read_retries);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ram_stats);
+
+/*
+ * Count vowels eight bytes at a time (SWAR). OR-ing 0x20 into every byte
+ * folds 'A'..'Z' onto 'a'..'z' and maps nothing else onto a lowercase vowel,
+ * so each vowel needs one XOR plus an exact zero-byte test per word instead
+ * of ten compares per byte.
+ */
+#define RAM_ONES (~0ULL / 0xff)  // 0x0101010101010101
+#define RAM_LOWS (RAM_ONES * 0x7f)
+
+// 0x80 in every byte of x that is zero, without false positives from borrows
+static inline u64 ram_zero_bytes(u64 x) {
+    return ~(((x & RAM_LOWS) + RAM_LOWS) | x | RAM_LOWS);
+}
+
+static inline bool ram_is_vowel(char c) {
+    c |= 0x20;
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+static size_t ram_count_vowels(const char *buf, size_t len) {
+    size_t count = 0;
+    const u64 *w;
+
+    // Head bytes up to the first aligned word
+    while (len && !IS_ALIGNED((unsigned long)buf, sizeof(u64))) {
+        count += ram_is_vowel(*buf++);
+        len--;
+    }
+
+    for (w = (const u64 *)buf; len >= sizeof(u64); w++, len -= sizeof(u64)) {
+        u64 x = *w | (RAM_ONES * 0x20);
+        u64 hits = ram_zero_bytes(x ^ (RAM_ONES * 'a')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'e')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'i')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'o')) |
+                   ram_zero_bytes(x ^ (RAM_ONES * 'u'));
+
+        count += hweight64(hits);
+    }
+
+    // Tail bytes
+    for (buf = (const char *)w; len; len--)
+        count += ram_is_vowel(*buf++);
+    return count;
+}
+
+// Function prototypes
+static int ram_open(struct inode *inode, struct file *file);
+static int ram_release(struct inode *inode, struct file *file);
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static loff_t ram_seek(struct file *file, loff_t offset, int whence);
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+
+static struct file_operations ram_fops = {
+    .owner = THIS_MODULE,
+    .open = ram_open,
+    .release = ram_release,
+    .read_iter = ram_read_iter,
+    .write_iter = ram_write_iter,
+    .llseek = ram_seek,
+    .unlocked_ioctl = ram_ioctl,
+};
+
+static int ram_open(struct inode *inode, struct file *file) {
+    printk(KERN_INFO "ram_array: Device opened\n");
+    ram_stat_inc(opens);
+    return 0;
+}
+
+static int ram_release(struct inode *inode, struct file *file) {
+    printk(KERN_INFO "ram_array: Device released\n");
+    return 0;
+}
+
+static ssize_t ram_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    size_t copied = 0, n, m;
+    unsigned int seq;
+    char *bounce;
+
+    if (pos >= buffer_size)
+        return 0;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
+    if (!count)
+        return 0;
+
+    bounce = kmalloc(min_t(size_t, count, RAM_BOUNCE_SIZE), GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+
+    /*
+     * Each piece of up to RAM_BOUNCE_SIZE bytes is a consistent snapshot. The
+     * copy to user space happens after the sequence check, so a page fault
+     * there cannot stall writers.
+     */
+    while (copied < count) {
+        n = min_t(size_t, count - copied, RAM_BOUNCE_SIZE);
+        seq = read_seqbegin(&ram_seqlock);
+        for (;;) {
+            memcpy(bounce, ram_array + pos + copied, n);
+            if (!read_seqretry(&ram_seqlock, seq))
+                break;
+            ram_stat_inc(read_retries);
+            seq = read_seqbegin(&ram_seqlock);
+        }
+
+        m = copy_to_iter(bounce, n, to);
+        copied += m;
+        if (m < n)
+            break;
+    }
+    kfree(bounce);
+
+    if (!copied) {
+        ram_stat_inc(efaults);
+        return -EFAULT;
+    }
+
+    ram_stat_inc(reads);
+    ram_stat_add(bytes_read, copied);
+    iocb->ki_pos = pos + copied;
+    pr_debug("ram_array: Read %zu bytes from position %lld\n", copied, pos);
+    return copied;
+}
+
+// A page per write section, with a reschedule in between, so readers only ever retry
+// for one page's worth of memset() rather than the whole buffer
+static void ram_clear_all(void) {
+    size_t off, n;
+
+    for (off = 0; off < buffer_size; off += n) {
+        n = min_t(size_t, PAGE_SIZE, buffer_size - off);
+        write_seqlock(&ram_seqlock);
+        // Subtract rather than zero the count: writers to other pages keep adding their deltas
+        ram_vowels -= ram_count_vowels(ram_array + off, n);
+        memset(ram_array + off, 0, n);
+        write_sequnlock(&ram_seqlock);
+        cond_resched();
+    }
+}
+
+static ssize_t ram_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    size_t copied = 0, n, m;
+    long vowels;
+    char *bounce;
+
+    if (pos >= buffer_size)
+        return 0;
+    if (count > buffer_size - pos)
+        count = buffer_size - pos;
+    if (!count)
+        return 0;
+
+    bounce = kmalloc(min_t(size_t, count, RAM_BOUNCE_SIZE), GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+
+    // Fetch from user space first: the write side spins, so it must not fault
+    while (copied < count) {
+        n = min_t(size_t, count - copied, RAM_BOUNCE_SIZE);
+        m = copy_from_iter(bounce, n, from);
+        if (!m)
+            break;
+        vowels = ram_count_vowels(bounce, m);
+
+        write_seqlock(&ram_seqlock);
+        vowels -= ram_count_vowels(ram_array + pos + copied, m);
+        memcpy(ram_array + pos + copied, bounce, m);
+        ram_vowels += vowels;
+        write_sequnlock(&ram_seqlock);
+
+        copied += m;
+        if (m < n)
+            break;
+    }
+    kfree(bounce);
+
+    if (!copied) {
+        ram_stat_inc(efaults);
+        return -EFAULT;
+    }
+
+    ram_stat_inc(writes);
+    ram_stat_add(bytes_written, copied);
+    iocb->ki_pos = pos + copied;
+    pr_debug("ram_array: Wrote %zu bytes at position %lld\n", copied, pos);
+    return copied;
+}
+
+static loff_t ram_seek(struct file *file, loff_t offset, int whence) {
+    loff_t new_pos;
+    switch (whence) {
+        case SEEK_SET: new_pos = offset; break;
+        case SEEK_CUR: new_pos = file->f_pos + offset; break;
+        case SEEK_END: new_pos = buffer_size + offset; break;
+        default: return -EINVAL;
+    }
+
+    if (new_pos < 0 || new_pos > buffer_size) return -EINVAL;
+    file->f_pos = new_pos;
+    return new_pos;
+}
+
+static long ram_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int size = min_t(unsigned long, buffer_size, INT_MAX);
+    u64 size64 = buffer_size;
+    unsigned int seq;
+    long vowels;
+    int count;
+
+    switch (cmd) {
+        case RAM_GET_SIZE:
+            if (copy_to_user((int __user *)arg, &size, sizeof(int)))
+                return -EFAULT;
+            break;
+
+        case RAM_GET_SIZE64:
+            if (copy_to_user((u64 __user *)arg, &size64, sizeof(u64)))
+                return -EFAULT;
+            break;
+
+        case RAM_CLEAR:
+            ram_clear_all();
+            pr_debug("ram_array: Buffer cleared\n");
+            break;
+
+        case RAM_COUNT_VOWELS:
+            do {
+                seq = read_seqbegin(&ram_seqlock);
+                vowels = ram_vowels;
+            } while (read_seqretry(&ram_seqlock, seq));
+            count = min_t(long, vowels, INT_MAX);
+            if (copy_to_user((int __user *)arg, &count, sizeof(int)))
+                return -EFAULT;
+            break;
+
+        default:
+            return -EINVAL;
+    }
+    return 0;
+}
+
+static long ram_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    long ret = ram_do_ioctl(file, cmd, arg);
+
+    ram_stat_inc(ioctls);
+    if (ret == -EFAULT)
+        ram_stat_inc(efaults);
+    return ret;
+}
+
+static int __init ram_init(void) {
+    if (!buffer_size)
+        return -EINVAL;
+
+    ram_array = vzalloc(buffer_size);
+    if (!ram_array)
+        return -ENOMEM;
+
+    major = register_chrdev(0, DEVICE_NAME, &ram_fops);
+    if (major < 0) {
+        printk(KERN_ALERT "ram_array: Failed to register char device\n");
+        vfree(ram_array);
+        return major;
+    }
+
+    ram_debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, ram_debugfs_dir, NULL, &ram_stats_fops);
+
+    printk(KERN_INFO "ram_array (seqlock) driver registered with major %d\n", major);
+    return 0;
+}
+
+static void __exit ram_exit(void) {
+    debugfs_remove_recursive(ram_debugfs_dir);
+    unregister_chrdev(major, DEVICE_NAME);
+    vfree(ram_array);
+    printk(KERN_INFO "ram_array: Driver unregistered\n");
+}
+
+module_init(ram_init);
+module_exit(ram_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Koushik");
+MODULE_DESCRIPTION("RAM-backed array device driver with seqlock-protected optimistic reads");